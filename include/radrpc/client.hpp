@@ -454,12 +454,14 @@ template <class client_session_> class client
      * [thread-safe]
      * @param call_id The id to call on serverside.
      * @param send_bytes The bytes to send.
-     * @return True if no error occured & response received, false if not.
+     * @return The received response, 'receive_buffer::status' tells
+     * if the server rejected it or was overloaded.
      */
     receive_buffer
     send_recv(uint32_t call_id, const char *data_ptr, std::size_t data_size)
     {
         receive_buffer result;
+        result.status = response_status::no_response;
         for (unsigned int i = 0; i < m_client_cfg.send_attempts; ++i)
         {
             if (i != 0)
@@ -501,7 +503,8 @@ template <class client_session_> class client
      * [thread-safe]
      * @param call_id The id to call on serverside.
      * @param send_bytes The bytes to send.
-     * @return True if no error occured & response received, false if not.
+     * @return The received response, 'receive_buffer::status' tells
+     * if the server rejected it or was overloaded.
      */
     receive_buffer send_recv(uint32_t call_id,
                              const std::vector<char> &send_bytes)
@@ -509,6 +512,36 @@ template <class client_session_> class client
         return send_recv(call_id, send_bytes.data(), send_bytes.size());
     }
 
+    /**
+     * Subscribes the session to a topic, the server needs
+     * to accept it with 'server::bind_subscribe()'.
+     * The subscriptions belong to the session & are
+     * not restored after a reconnect.
+     * [thread-safe]
+     * @param topic The topic to subscribe to.
+     * @return True if subscribed, false if not.
+     */
+    bool subscribe(const std::string &topic)
+    {
+        auto result =
+            send_recv(config::subscribe_call_id, topic.data(), topic.size());
+        return result.size() == 1 && result.data()[0] == 1;
+    }
+
+    /**
+     * Unsubscribes the session from a topic.
+     * [thread-safe]
+     * @param topic The topic to unsubscribe from.
+     * @return True if unsubscribed, false if it was not subscribed
+     * or the server didn't process the request.
+     */
+    bool unsubscribe(const std::string &topic)
+    {
+        auto result =
+            send_recv(config::unsubscribe_call_id, topic.data(), topic.size());
+        return result.size() == 1 && result.data()[0] == 1;
+    }
+
     /**
      * Sets the handshake which will be
      * sent to the server with 'connect()'.
@@ -37,6 +37,14 @@ constexpr int64_t deadlock_secs = 30;
 constexpr std::size_t io_timeout_secs = 5;
 constexpr std::size_t queue_send_max = 500;
 constexpr std::size_t queue_recv_max = 500;
+constexpr std::size_t registry_shards = 64;
+constexpr std::size_t inbox_size = 64;
+constexpr std::size_t compact_buffer_bytes = 4096;
+constexpr std::size_t buffer_cache_slots = 4;
+constexpr std::size_t buffer_cache_max_bytes = 64 * 1024;
+constexpr std::size_t ip_table_slots = 1024;
+constexpr uint32_t subscribe_call_id = 0xFFFFFFF0;
+constexpr uint32_t unsubscribe_call_id = 0xFFFFFFF1;
 
 } // namespace config
 } // namespace radrpc
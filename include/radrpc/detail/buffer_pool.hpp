@@ -0,0 +1,428 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#ifndef RADRPC_DETAIL_BUFFER_POOL_HPP
+#define RADRPC_DETAIL_BUFFER_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include <boost/beast/core/flat_buffer.hpp>
+
+#include <radrpc/config.hpp>
+#include <radrpc/types.hpp>
+
+namespace radrpc {
+namespace detail {
+
+/**
+ * Keeps released buffers for reuse by size classes of powers of two,
+ * up to a limit of pooled bytes. Buffers released beyond the limit
+ * or larger than the largest class are freed, so the memory tracks
+ * the buffers in use rather than the peak.
+ * Each worker attached by a 'worker_scope' keeps a few small buffers
+ * of each class in its own cache, which only this worker touches, so
+ * these are taken & released without locking & stay on the memory of
+ * the worker. Other threads & larger buffers use the locked shared pool.
+ * The cached buffers count towards the limit & are freed on 'clear()'
+ * like the pooled ones. Since the buffers are plain allocations, a
+ * buffer may be released on another thread or pool than it was taken
+ * from.
+ */
+class buffer_pool
+{
+    static constexpr std::size_t min_shift = 8; ///< The smallest class.
+    static constexpr std::size_t classes = 13;  ///< Up to 1 MiB.
+
+    /**
+     * The buffers kept by one worker in front of the shared pool.
+     */
+    struct cache
+    {
+        void *slots[classes][config::buffer_cache_slots]; ///< The buffers.
+        std::size_t counts[classes]; ///< The buffers kept of each class.
+        std::atomic<bool> flush;     ///< Whether to free the buffers.
+        std::atomic<uint64_t> hits;  ///< The allocations served by it.
+        std::atomic<uint64_t> misses; ///< The allocations missing it.
+
+        cache() : slots(), counts(), flush(false), hits(0), misses(0) {}
+    };
+
+    /**
+     * The cache of the worker running on the calling thread.
+     */
+    struct binding
+    {
+        buffer_pool *pool; ///< The pool the worker is attached to.
+        cache *c;          ///< The cache of the worker.
+    };
+
+    std::mutex m_mtx;                   ///< Lock, shared by all sessions.
+    std::vector<void *> m_free[classes]; ///< The released buffers by class.
+    std::vector<std::unique_ptr<cache>>
+        m_caches;                      ///< The caches of the attached workers.
+    const std::size_t m_limit;         ///< The bytes to keep at most.
+    std::atomic<std::size_t> m_pooled; ///< The bytes currently kept.
+    std::atomic<uint64_t>
+        m_hits; ///< The allocations served by a released buffer.
+    std::atomic<uint64_t> m_misses; ///< The allocations which weren't pooled.
+
+    /**
+     * @return The binding of the calling thread.
+     */
+    static binding &bound()
+    {
+        static thread_local binding b{nullptr, nullptr};
+        return b;
+    }
+
+    /**
+     * @param bytes The size to allocate.
+     * @return The size class, 'classes' if too large to pool.
+     */
+    static std::size_t class_of(std::size_t bytes)
+    {
+        std::size_t index = 0;
+        while (index < classes && (std::size_t(1) << (min_shift + index)) <
+                                      bytes)
+            ++index;
+        return index;
+    }
+
+    /**
+     * Increments a counter, which is only written by one thread.
+     * @param counter The counter to increment.
+     */
+    static void count(std::atomic<uint64_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    }
+
+    /**
+     * Frees the buffers of a cache.
+     * @param c The cache to empty.
+     */
+    void flush(cache &c)
+    {
+        for (std::size_t index = 0; index < classes; ++index)
+        {
+            for (std::size_t i = 0; i < c.counts[index]; ++i)
+                ::operator delete(c.slots[index][i]);
+            m_pooled -= c.counts[index] *
+                        (std::size_t(1) << (min_shift + index));
+            c.counts[index] = 0;
+        }
+    }
+
+    /**
+     * @param index The size class.
+     * @return The cache of the calling worker if the class is cached.
+     */
+    cache *cache_of(std::size_t index)
+    {
+        auto &b = bound();
+        if (b.pool != this ||
+            (std::size_t(1) << (min_shift + index)) >
+                config::buffer_cache_max_bytes)
+            return nullptr;
+        // Emptied by the worker itself after 'clear()'
+        if (b.c->flush.load(std::memory_order_relaxed) &&
+            b.c->flush.exchange(false))
+            flush(*b.c);
+        return b.c;
+    }
+
+    /**
+     * Attaches a cache to the calling thread.
+     * @return True if attached, false if no cache is used.
+     */
+    bool attach()
+    {
+        auto &b = bound();
+        if (m_limit == 0 || b.pool)
+            return false;
+        // Allocated by the worker to place it on its memory
+        std::unique_ptr<cache> c(new cache());
+        b.c = c.get();
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_caches.push_back(std::move(c));
+        b.pool = this;
+        return true;
+    }
+
+    /**
+     * Detaches the cache of the calling thread,
+     * its buffers are moved to the shared pool.
+     */
+    void detach()
+    {
+        auto &b = bound();
+        auto c = b.c;
+        b = binding{nullptr, nullptr};
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (c->flush)
+            flush(*c);
+        for (std::size_t index = 0; index < classes; ++index)
+        {
+            for (std::size_t i = 0; i < c->counts[index]; ++i)
+                m_free[index].push_back(c->slots[index][i]);
+        }
+        m_hits += c->hits;
+        m_misses += c->misses;
+        for (auto it = m_caches.begin(); it != m_caches.end(); ++it)
+        {
+            if (it->get() == c)
+            {
+                m_caches.erase(it);
+                break;
+            }
+        }
+    }
+
+  public:
+    /**
+     * Attaches a cache to the worker running on the calling thread,
+     * until this scope ends. A thread can be attached to one pool.
+     */
+    class worker_scope
+    {
+        std::shared_ptr<buffer_pool> m_pool; ///< The pool attached to.
+
+      public:
+        /**
+         * @param p_pool The pool to attach to.
+         */
+        explicit worker_scope(std::shared_ptr<buffer_pool> p_pool) :
+            m_pool(std::move(p_pool))
+        {
+            if (!m_pool->attach())
+                m_pool.reset();
+        }
+
+        worker_scope(const worker_scope &) = delete;
+        worker_scope &operator=(const worker_scope &) = delete;
+
+        ~worker_scope()
+        {
+            if (m_pool)
+                m_pool->detach();
+        }
+    };
+
+    /**
+     * @param p_limit The bytes to keep at most, zero to free all.
+     */
+    explicit buffer_pool(std::size_t p_limit) :
+        m_limit(p_limit),
+        m_pooled(0),
+        m_hits(0),
+        m_misses(0)
+    {
+    }
+
+    buffer_pool(const buffer_pool &) = delete;
+    buffer_pool &operator=(const buffer_pool &) = delete;
+
+    ~buffer_pool() { clear(); }
+
+    /**
+     * Allocates a buffer, reusing a released one of its class.
+     * [thread-safe]
+     * @param bytes The size to allocate.
+     * @return The allocated buffer.
+     */
+    void *allocate(std::size_t bytes)
+    {
+        auto index = class_of(bytes);
+        if (index == classes)
+            return ::operator new(bytes);
+        auto size = std::size_t(1) << (min_shift + index);
+        auto c = cache_of(index);
+        if (c && c->counts[index] != 0)
+        {
+            m_pooled -= size;
+            count(c->hits);
+            return c->slots[index][--c->counts[index]];
+        }
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            auto &free = m_free[index];
+            if (!free.empty())
+            {
+                auto p = free.back();
+                free.pop_back();
+                m_pooled -= size;
+                ++m_hits;
+                return p;
+            }
+        }
+        if (c)
+            count(c->misses);
+        else
+            ++m_misses;
+        return ::operator new(size);
+    }
+
+    /**
+     * Releases a buffer to the pool or frees it if the pool is full.
+     * [thread-safe]
+     * @param p The buffer to release.
+     * @param bytes The size it was allocated with.
+     */
+    void deallocate(void *p, std::size_t bytes)
+    {
+        auto index = class_of(bytes);
+        if (index != classes)
+        {
+            auto size = std::size_t(1) << (min_shift + index);
+            // Reserve the bytes before keeping the buffer
+            if (m_pooled.fetch_add(size) + size <= m_limit)
+            {
+                auto c = cache_of(index);
+                if (c && c->counts[index] != config::buffer_cache_slots)
+                {
+                    c->slots[index][c->counts[index]++] = p;
+                    return;
+                }
+                std::unique_lock<std::mutex> lock(m_mtx);
+                m_free[index].push_back(p);
+                return;
+            }
+            m_pooled -= size;
+        }
+        ::operator delete(p);
+    }
+
+    /**
+     * Frees all released buffers of the shared pool, the caches
+     * are freed by their workers on their next use.
+     * [thread-safe]
+     */
+    void clear()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        for (auto &c : m_caches)
+            c->flush = true;
+        for (std::size_t index = 0; index < classes; ++index)
+        {
+            auto &free = m_free[index];
+            for (auto p : free)
+                ::operator delete(p);
+            m_pooled -= free.size() * (std::size_t(1) << (min_shift + index));
+            std::vector<void *>().swap(free);
+        }
+    }
+
+    /**
+     * [thread-safe]
+     * @return The statistics of the pool, including the caches.
+     */
+    buffer_pool_stats stats()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        buffer_pool_stats stats{m_pooled, m_hits, m_misses};
+        for (auto &c : m_caches)
+        {
+            stats.hits += c->hits;
+            stats.misses += c->misses;
+        }
+        return stats;
+    }
+};
+
+/**
+ * An allocator drawing from a shared buffer pool,
+ * or from the heap if none is set.
+ * A container moved into another one takes its pool along, while
+ * the moved-from container keeps drawing from the same pool.
+ * @tparam T The type to allocate.
+ */
+template <typename T> class pool_allocator
+{
+    template <typename U> friend class pool_allocator;
+
+    std::shared_ptr<buffer_pool> m_pool; ///< The pool to draw from.
+
+  public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+
+    pool_allocator() = default;
+    pool_allocator(const pool_allocator &) = default;
+    pool_allocator &operator=(const pool_allocator &) = default;
+
+    /**
+     * @param p_pool The pool to draw from, nullptr for the heap.
+     */
+    explicit pool_allocator(std::shared_ptr<buffer_pool> p_pool) :
+        m_pool(std::move(p_pool))
+    {
+    }
+
+    template <typename U>
+    pool_allocator(const pool_allocator<U> &other) : m_pool(other.m_pool)
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        if (!m_pool)
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        return static_cast<T *>(m_pool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        if (!m_pool)
+            return ::operator delete(p);
+        m_pool->deallocate(p, n * sizeof(T));
+    }
+
+    template <typename U> bool operator==(const pool_allocator<U> &other) const
+    {
+        return m_pool == other.m_pool;
+    }
+
+    template <typename U> bool operator!=(const pool_allocator<U> &other) const
+    {
+        return m_pool != other.m_pool;
+    }
+};
+
+typedef boost::beast::basic_flat_buffer<pool_allocator<char>>
+    pooled_flat_buffer; ///< A flat buffer drawing from a buffer pool.
+typedef std::vector<char, pool_allocator<char>>
+    pooled_vector; ///< Bytes drawing from a buffer pool.
+
+} // namespace detail
+} // namespace radrpc
+
+#endif // RADRPC_DETAIL_BUFFER_POOL_HPP
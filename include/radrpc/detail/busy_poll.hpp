@@ -0,0 +1,117 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#ifndef RADRPC_DETAIL_BUSY_POLL_HPP
+#define RADRPC_DETAIL_BUSY_POLL_HPP
+
+#include <chrono>
+
+#include <boost/asio/io_context.hpp>
+
+#include <radrpc/config.hpp>
+#include <radrpc/debug.hpp>
+#include <radrpc/types.hpp>
+
+namespace radrpc {
+namespace detail {
+
+#ifdef SO_BUSY_POLL
+typedef boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>
+    busy_poll; ///< Lets the kernel poll the device queue on blocking reads.
+#endif
+
+/**
+ * Runs the io context until it is stopped, out of work or left.
+ * Polls the io context without sleeping until no handler
+ * was ready for the spin budget, then blocks for the next handler.
+ * @param io_ctx The io context to run.
+ * @param spin_budget The time to poll before blocking,
+ * zero to block immediately.
+ * @param leave Set by a handler of the calling thread to leave the
+ * io context after this handler, nullptr to run until stopped.
+ */
+inline void run_busy_poll(boost::asio::io_context &io_ctx,
+                          duration spin_budget,
+                          const bool *leave = nullptr)
+{
+    if (spin_budget <= duration::zero())
+    {
+        if (!leave)
+        {
+            io_ctx.run();
+            return;
+        }
+        while (!*leave && io_ctx.run_one() != 0)
+            ;
+        return;
+    }
+    auto idle_since = std::chrono::steady_clock::now();
+    while (!io_ctx.stopped() && !(leave && *leave))
+    {
+        if (io_ctx.poll_one() > 0)
+        {
+            idle_since = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (std::chrono::steady_clock::now() - idle_since < spin_budget)
+            continue;
+        if (io_ctx.run_one() == 0)
+            break;
+        idle_since = std::chrono::steady_clock::now();
+    }
+}
+
+/**
+ * Sets SO_BUSY_POLL on the socket.
+ * Raising it above 'net.core.busy_poll' requires CAP_NET_ADMIN.
+ * @param socket The socket to set the option on.
+ * @param timeout The time to busy poll, zero to skip.
+ * @return True if set, false if skipped, failed or not supported.
+ */
+inline bool set_busy_poll(tcp::socket &socket, duration timeout)
+{
+    if (timeout <= duration::zero())
+        return false;
+#ifdef SO_BUSY_POLL
+    boost::system::error_code ec;
+    socket.set_option(
+        busy_poll(static_cast<int>(
+            std::chrono::duration_cast<std::chrono::microseconds>(timeout)
+                .count())),
+        ec);
+    if (ec)
+    {
+        RADRPC_LOG("set_busy_poll: " << ec.message());
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace detail
+} // namespace radrpc
+
+#endif // RADRPC_DETAIL_BUSY_POLL_HPP
@@ -0,0 +1,261 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#ifndef RADRPC_DETAIL_CIDR_TRIE_HPP
+#define RADRPC_DETAIL_CIDR_TRIE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+namespace radrpc {
+namespace detail {
+
+/**
+ * An ipv6 address, ipv4 addresses are mapped to "::ffff:0:0/96".
+ */
+typedef boost::asio::ip::address_v6::bytes_type ip_bytes;
+
+/**
+ * Converts an address to its ipv6 bytes.
+ * @param address The address to convert.
+ * @return The bytes of the address.
+ */
+inline ip_bytes to_ip_bytes(const boost::asio::ip::address &address)
+{
+    if (address.is_v4())
+        return boost::asio::ip::make_address_v6(boost::asio::ip::v4_mapped,
+                                                address.to_v4())
+            .to_bytes();
+    return address.to_v6().to_bytes();
+}
+
+/**
+ * Parses a range like "10.0.0.0/8", "2001:db8::/32" or a single address.
+ * @param cidr The range to parse.
+ * @param bytes The parsed address.
+ * @param length The parsed prefix length in bits of the ipv6 address.
+ * @return True if parsed, false if invalid.
+ */
+inline bool
+parse_cidr(const std::string &cidr, ip_bytes &bytes, unsigned int &length)
+{
+    auto separator = cidr.find('/');
+    boost::system::error_code ec;
+    auto address =
+        boost::asio::ip::make_address(cidr.substr(0, separator), ec);
+    if (ec)
+        return false;
+    unsigned int max_length = address.is_v4() ? 32 : 128;
+    length = max_length;
+    if (separator != std::string::npos)
+    {
+        auto digits = cidr.substr(separator + 1);
+        if (digits.empty() || digits.size() > 3 ||
+            digits.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        length = static_cast<unsigned int>(std::stoul(digits));
+        if (length > max_length)
+            return false;
+    }
+    bytes = to_ip_bytes(address);
+    if (address.is_v4())
+        length += 96;
+    return true;
+}
+
+/**
+ * A path compressed binary trie of address ranges, which
+ * finds the most specific range containing an address.
+ */
+class cidr_trie
+{
+    /**
+     * A range & the branches below it.
+     */
+    struct node
+    {
+        ip_bytes bits;         ///< The prefix, zero behind its length.
+        unsigned char length;  ///< The prefix length in bits.
+        signed char value;     ///< The value of the range, -1 if none.
+        uint32_t children[2];  ///< The branches by the next bit, 0 if none.
+    };
+
+    std::vector<node> m_nodes; ///< The nodes, the first one is the root.
+
+    /**
+     * @param bytes The address.
+     * @param index The index of the bit.
+     * @return The bit at the index.
+     */
+    static unsigned int bit(const ip_bytes &bytes, unsigned int index)
+    {
+        return (bytes[index / 8] >> (7 - index % 8)) & 1;
+    }
+
+    /**
+     * Counts the equal leading bits.
+     * @param a The first address.
+     * @param b The second address.
+     * @param max The maximum bits to compare.
+     * @return The amount of equal leading bits.
+     */
+    static unsigned int
+    common(const ip_bytes &a, const ip_bytes &b, unsigned int max)
+    {
+        unsigned int length = 0;
+        while (length < max)
+        {
+            auto diff = static_cast<unsigned char>(a[length / 8] ^
+                                                   b[length / 8]);
+            if (diff == 0)
+            {
+                length += 8;
+                continue;
+            }
+            while (!(diff & 0x80))
+            {
+                diff <<= 1;
+                ++length;
+            }
+            break;
+        }
+        return (std::min)(length, max);
+    }
+
+    /**
+     * @param bytes The address.
+     * @param length The prefix length.
+     * @return The address with zero bits behind the prefix length.
+     */
+    static ip_bytes mask(ip_bytes bytes, unsigned int length)
+    {
+        for (unsigned int i = 0; i < bytes.size(); ++i)
+        {
+            if (length >= (i + 1) * 8)
+                continue;
+            auto keep = length > i * 8 ? length - i * 8 : 0;
+            bytes[i] &= static_cast<unsigned char>(0xFF00 >> keep);
+        }
+        return bytes;
+    }
+
+    /**
+     * Appends a node.
+     * @return The index of the node.
+     */
+    uint32_t add(const ip_bytes &bits, unsigned int length, int value)
+    {
+        m_nodes.push_back(node{mask(bits, length),
+                               static_cast<unsigned char>(length),
+                               static_cast<signed char>(value),
+                               {0, 0}});
+        return static_cast<uint32_t>(m_nodes.size() - 1);
+    }
+
+  public:
+    cidr_trie() { add(ip_bytes(), 0, -1); }
+
+    /**
+     * Sets the value of a range.
+     * @param bits The address of the range.
+     * @param length The prefix length in bits, at most 128.
+     * @param value The value of the range, at least zero.
+     */
+    void insert(const ip_bytes &bits, unsigned int length, int value)
+    {
+        uint32_t index = 0;
+        while (true)
+        {
+            if (m_nodes[index].length == length)
+            {
+                m_nodes[index].value = static_cast<signed char>(value);
+                return;
+            }
+            auto branch = bit(bits, m_nodes[index].length);
+            auto child = m_nodes[index].children[branch];
+            if (child == 0)
+            {
+                auto leaf = add(bits, length, value);
+                m_nodes[index].children[branch] = leaf;
+                return;
+            }
+            unsigned int child_length = m_nodes[child].length;
+            auto equal = common(
+                bits, m_nodes[child].bits, (std::min)(length, child_length));
+            if (equal == child_length)
+            {
+                index = child;
+                continue;
+            }
+            // Split the branch at the first different bit
+            auto split = add(bits, equal, equal == length ? value : -1);
+            m_nodes[split].children[bit(m_nodes[child].bits, equal)] = child;
+            if (equal != length)
+                m_nodes[split].children[bit(bits, equal)] =
+                    add(bits, length, value);
+            m_nodes[index].children[branch] = split;
+            return;
+        }
+    }
+
+    /**
+     * Finds the most specific range containing the address.
+     * @param bytes The address.
+     * @return The value of the range, -1 if none contains it.
+     */
+    int match(const ip_bytes &bytes) const
+    {
+        int value = -1;
+        uint32_t index = 0;
+        while (true)
+        {
+            const auto &n = m_nodes[index];
+            if (common(bytes, n.bits, n.length) < n.length)
+                break;
+            if (n.value >= 0)
+                value = n.value;
+            if (n.length == 128)
+                break;
+            index = n.children[bit(bytes, n.length)];
+            if (index == 0)
+                break;
+        }
+        return value;
+    }
+
+    /**
+     * @return The amount of nodes.
+     */
+    std::size_t size() const { return m_nodes.size(); }
+};
+
+} // namespace detail
+} // namespace radrpc
+
+#endif // RADRPC_DETAIL_CIDR_TRIE_HPP
@@ -26,13 +26,17 @@
 #define RADRPC_DETAIL_DATA_HPP
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstddef>
 #include <condition_variable>
 #include <deque>
 #include <future>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -40,6 +44,8 @@
 
 #include <radrpc/config.hpp>
 #include <radrpc/debug.hpp>
+#include <radrpc/detail/buffer_pool.hpp>
+#include <radrpc/types.hpp>
 
 namespace radrpc {
 namespace detail {
@@ -56,6 +62,18 @@ enum class data_state
     swapped,
 };
 
+/**
+ * Represent the result of a request, sent
+ * back to the client within the io_header.
+ * @see radrpc::detail::io_header
+ */
+enum class io_status : uint32_t
+{
+    ok,       ///< The request was processed.
+    rejected, ///< The request was rejected by the server.
+    overloaded, ///< The request waited too long & was shed by the server.
+};
+
 #ifdef _WIN32
 #pragma pack(push, 1)
 /**
@@ -72,12 +90,12 @@ struct __attribute__((packed)) io_header
 #endif
 {
     uint32_t call_id;   ///< The id to call on the remote host.
-    uint32_t pad0;      ///< Reserved field used as padding.
+    uint32_t status;    ///< The result status represented by 'io_status'.
     uint64_t result_id; ///< The id which will be sent back to caller.
 
     io_header(uint32_t p_call_id, uint64_t p_result_id) :
         call_id(p_call_id),
-        pad0(0),
+        status(static_cast<uint32_t>(io_status::ok)),
         result_id(p_result_id)
     {
     }
@@ -98,6 +116,7 @@ class data_read : public std::enable_shared_from_this<data_read>
     time_point timestamp; ///< Creation timestamp.
     int64_t valid_ms;     ///< Used to check whether data is still valid.
     data_state state;     ///< The state of the data.
+    io_status status;     ///< The status sent along with the data.
     boost::beast::flat_buffer read_buffer; ///< The data buffer.
     std::mutex mtx; ///< Used to lock & change data.
     std::condition_variable cv; ///< Used in 'data_cache' to wait on.
@@ -110,7 +129,8 @@ class data_read : public std::enable_shared_from_this<data_read>
         timestamp(p_timestamp),
         valid_ms(std::chrono::duration_cast<std::chrono::milliseconds>(p_valid)
                      .count()),
-        state(data_state::queued)
+        state(data_state::queued),
+        status(io_status::ok)
     {
     }
 
@@ -134,9 +154,346 @@ class data_push : public std::enable_shared_from_this<data_push>
   public:
     // duration timeout;
     io_header header;       ///<
-    std::vector<char> body; ///<
+    std::vector<char> body; ///< The owned body, unused with 'shared_body'.
+    pooled_vector pooled_body; ///< The owned body if 'body' is empty.
+    std::shared_ptr<const std::vector<char>>
+        shared_body; ///< An immutable body, shared by e.g. broadcasts.
+    send_priority priority; ///< The priority to queue the data with.
+    bool conflate; ///< Whether to replace unsent data with the same key.
+    uint64_t conflation_key; ///< The key of the data to replace.
+
+    /**
+     * @param p_io_header The header to send along with the body.
+     * @param p_priority The priority to queue the data with.
+     */
+    explicit data_push(const io_header &p_io_header,
+                       send_priority p_priority = send_priority::response) :
+        header(p_io_header),
+        priority(p_priority),
+        conflate(false),
+        conflation_key(0)
+    {
+    }
+
+    /**
+     * Returns the body to send.
+     * @return The shared body if set, otherwise the owned body.
+     */
+    boost::asio::const_buffer body_buffer() const
+    {
+        if (shared_body)
+            return boost::asio::buffer(*shared_body);
+        if (body.empty())
+            return boost::asio::buffer(pooled_body);
+        return boost::asio::buffer(body);
+    }
+
+    /**
+     * Returns the size to write.
+     * @return The size of the header & body in bytes.
+     */
+    std::size_t size() const
+    {
+        return sizeof(io_header) + body_buffer().size();
+    }
+};
+
+/**
+ * Provides a solution to hold the data which needs to be
+ * written to the client. The data is dequeued by strict priority,
+ * while the order of data with the same priority is kept.
+ * Conflated data replaces the queued data with the same key
+ * & priority in place, so only the latest one is written.
+ * The lanes are allocated with their first data & can be released
+ * while the queue is empty.
+ * This will be usually used in tandem with the websocket's 'async_write()'
+ * function within the IO context/thread.
+ * Using it external will result in data races.
+ */
+class push_queue
+{
+    /**
+     * The queued data with the time it was queued.
+     */
+    struct entry
+    {
+        std::shared_ptr<data_push> data; ///< The queued data.
+        time_point queued;               ///< The time the data was queued.
+    };
+
+    static constexpr std::size_t m_lanes =
+        static_cast<std::size_t>(send_priority::broadcast) + 1;
+    std::unique_ptr<std::deque<entry>>
+        m_entries[m_lanes]; ///< Queued data for each priority.
+    std::unordered_map<uint64_t, entry *>
+        m_conflated[m_lanes]; ///< The queued conflated data by key.
+    std::size_t m_size;       ///< The amount of queued data.
+    std::size_t m_bytes;      ///< The size of the queued data in bytes.
+
+    /**
+     * Returns the lane of a priority & allocates it if released.
+     * @param index The index of the priority.
+     * @return The lane of the priority.
+     */
+    std::deque<entry> &lane_of(std::size_t index)
+    {
+        if (!m_entries[index])
+            m_entries[index].reset(new std::deque<entry>());
+        return *m_entries[index];
+    }
+
+  public:
+    push_queue() : m_size(0), m_bytes(0) {}
+
+    /**
+     * Returns the amount of queued data.
+     * @return The amount of queued data.
+     */
+    std::size_t size() const { return m_size; }
+
+    /**
+     * Returns the size of the queued data in bytes.
+     * @return The size of the queued data.
+     */
+    std::size_t bytes() const { return m_bytes; }
+
+    /**
+     * Checks whether the queue is empty.
+     * @return True if empty, false if not.
+     */
+    bool empty() const { return m_size == 0; }
+
+    /**
+     * Returns the time the oldest data was queued.
+     * @return The time, or the maximum time point if empty.
+     */
+    time_point oldest() const
+    {
+        auto oldest = (time_point::max)();
+        for (const auto &lane : m_entries)
+            if (lane && !lane->empty())
+                oldest = (std::min)(oldest, lane->front().queued);
+        return oldest;
+    }
+
+    /**
+     * Queue the data by its priority.
+     * @param data The data to queue.
+     */
+    void push(std::shared_ptr<data_push> data)
+    {
+        auto lane = static_cast<std::size_t>(data->priority);
+        auto conflate = data->conflate;
+        auto key = data->conflation_key;
+        m_bytes += data->size();
+        auto &entries = lane_of(lane);
+        entries.push_back(
+            entry{std::move(data), std::chrono::steady_clock::now()});
+        ++m_size;
+        // References to the elements of a deque stay
+        // valid while pushing back & popping front.
+        if (conflate)
+            m_conflated[lane][key] = &entries.back();
+    }
+
+    /**
+     * Returns the queued data, which would be replaced by the data.
+     * @param data The conflated data.
+     * @return The queued data, nullptr if there is no data to replace.
+     */
+    const data_push *conflated(const data_push &data) const
+    {
+        if (!data.conflate)
+            return nullptr;
+        auto &conflated = m_conflated[static_cast<std::size_t>(data.priority)];
+        auto itr = conflated.find(data.conflation_key);
+        if (itr == conflated.end())
+            return nullptr;
+        return itr->second->data.get();
+    }
+
+    /**
+     * Replaces the queued data with the same conflation key.
+     * The replacing data keeps the time the replaced one was queued.
+     * @param data The conflated data.
+     * @return True if replaced, false if there was no data to replace.
+     */
+    bool replace(const std::shared_ptr<data_push> &data)
+    {
+        if (!data->conflate)
+            return false;
+        auto &conflated = m_conflated[static_cast<std::size_t>(data->priority)];
+        auto itr = conflated.find(data->conflation_key);
+        if (itr == conflated.end())
+            return false;
+        m_bytes = m_bytes - itr->second->data->size() + data->size();
+        itr->second->data = data;
+        return true;
+    }
+
+    /**
+     * Removes & returns the data with the highest priority.
+     * @param queued The time the returned data was queued.
+     * @return The data with the highest priority, nullptr if empty.
+     */
+    std::shared_ptr<data_push> pop(time_point &queued)
+    {
+        for (auto &lane : m_entries)
+        {
+            if (!lane || lane->empty())
+                continue;
+            auto data = std::move(lane->front().data);
+            queued = lane->front().queued;
+            lane->pop_front();
+            --m_size;
+            m_bytes -= data->size();
+            if (data->conflate)
+                m_conflated[static_cast<std::size_t>(data->priority)].erase(
+                    data->conflation_key);
+            return data;
+        }
+        return nullptr;
+    }
+
+    /**
+     * Removes & returns the data with the highest priority.
+     * @return The data with the highest priority, nullptr if empty.
+     */
+    std::shared_ptr<data_push> pop()
+    {
+        time_point queued;
+        return pop(queued);
+    }
+
+    /**
+     * Clears the queued data of a priority.
+     * @param priority The priority to clear.
+     */
+    void clear(send_priority priority)
+    {
+        auto &lane = m_entries[static_cast<std::size_t>(priority)];
+        if (!lane)
+            return;
+        for (const auto &queued : *lane)
+            m_bytes -= queued.data->size();
+        m_size -= lane->size();
+        lane->clear();
+        m_conflated[static_cast<std::size_t>(priority)].clear();
+    }
+
+    /**
+     * Clears all queued data.
+     */
+    void clear()
+    {
+        for (auto &lane : m_entries)
+            if (lane)
+                lane->clear();
+        for (auto &conflated : m_conflated)
+            conflated.clear();
+        m_size = 0;
+        m_bytes = 0;
+    }
+
+    /**
+     * Releases the memory of the lanes if the queue is empty.
+     */
+    void shrink()
+    {
+        if (m_size != 0)
+            return;
+        for (auto &lane : m_entries)
+            lane.reset();
+        for (auto &conflated : m_conflated)
+            std::unordered_map<uint64_t, entry *>().swap(conflated);
+    }
+};
+
+/**
+ * A bounded lock-free queue for multiple producers & a single consumer.
+ * Each slot carries a sequence number which tells whether it is
+ * free for the producer or ready for the consumer, so pushing
+ * neither locks nor allocates. The order of the data pushed
+ * by one producer is kept.
+ * @tparam T The type of the data.
+ * @tparam Capacity The amount of slots, must be a power of two.
+ */
+template <typename T, std::size_t Capacity> class mpsc_ring
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "mpsc_ring: Capacity must be a power of two.");
+
+    struct slot
+    {
+        std::atomic<std::size_t> sequence; ///< The state of the slot.
+        T value;                           ///< The data of the slot.
+    };
+
+    std::array<slot, Capacity> m_slots; ///< The slots of the ring.
+    std::atomic<std::size_t> m_tail;    ///< The next position to push.
+    std::size_t m_head; ///< The next position to pop, only used by consumer.
+
+  public:
+    mpsc_ring() : m_tail(0), m_head(0)
+    {
+        for (std::size_t i = 0; i < Capacity; ++i)
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    /**
+     * Pushes the data if a slot is free.
+     * [thread-safe]
+     * @param value The data to push.
+     * @return True if pushed, false if full.
+     */
+    bool push(T value)
+    {
+        auto pos = m_tail.load(std::memory_order_relaxed);
+        slot *s;
+        for (;;)
+        {
+            s = &m_slots[pos & (Capacity - 1)];
+            auto sequence = s->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) -
+                        static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (m_tail.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        s->value = std::move(value);
+        s->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
 
-    explicit data_push(const io_header &p_io_header) : header(p_io_header) {}
+    /**
+     * Pops the oldest data if it is ready.
+     * This must be only called by the consumer.
+     * @param value The popped data.
+     * @return True if popped, false if empty.
+     */
+    bool pop(T &value)
+    {
+        auto &s = m_slots[m_head & (Capacity - 1)];
+        auto sequence = s.sequence.load(std::memory_order_acquire);
+        if (sequence != m_head + 1)
+            return false;
+        value = std::move(s.value);
+        s.value = T();
+        s.sequence.store(m_head + Capacity, std::memory_order_release);
+        ++m_head;
+        return true;
+    }
 };
 
 /**
@@ -260,6 +617,40 @@ class data_cache
         return success;
     }
 
+    /**
+     * Wait for the data which was queued by 'queue()'.
+     * @param id The id to wait on.
+     * @param timeout The timeout.
+     * @param buffer The empty buffer to swap the received data in queue,
+     * which also gets the status of the data.
+     * @return True if data received, false if timeout or invalid id.
+     */
+    bool wait(uint64_t id, duration timeout, receive_buffer &buffer)
+    {
+        std::shared_ptr<data_read> row;
+        auto success = wait(id, timeout, row);
+        if (row)
+        {
+            std::unique_lock<std::mutex> row_lock(row->mtx);
+            std::swap(buffer.base(), row->read_buffer);
+            switch (row->status)
+            {
+                case io_status::ok:
+                    buffer.status = response_status::ok;
+                    break;
+                case io_status::overloaded:
+                    buffer.status = response_status::overloaded;
+                    break;
+                default:
+                    buffer.status = response_status::rejected;
+                    break;
+            }
+        }
+        if (!success)
+            buffer.status = response_status::no_response;
+        return success;
+    }
+
     /**
      * Wait for the data which was queued by 'queue()'.
      * @param id The id to wait on.
@@ -301,8 +692,11 @@ class data_cache
      * all. This function will usually used for receiving data from the server.
      * @param id The id of the data.
      * @param buffer The buffer with the received data.
+     * @param status The status sent along with the data.
      */
-    void swap_notify(uint64_t id, boost::beast::flat_buffer &buffer)
+    void swap_notify(uint64_t id,
+                     boost::beast::flat_buffer &buffer,
+                     io_status status = io_status::ok)
     {
         std::unique_lock<std::mutex> table_lock(m_mtx);
         auto cache_itr = m_entries.find(id);
@@ -316,6 +710,7 @@ class data_cache
                 std::swap(buffer, row->read_buffer);
                 buffer = boost::beast::flat_buffer();
                 row->state = data_state::swapped;
+                row->status = status;
             }
             if (state == data_state::waiting)
             {
@@ -0,0 +1,239 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#ifndef RADRPC_DETAIL_PLACEMENT_HPP
+#define RADRPC_DETAIL_PLACEMENT_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <radrpc/debug.hpp>
+#include <radrpc/types.hpp>
+
+namespace radrpc {
+namespace detail {
+
+/**
+ * Parses a cpu list of the form "0-3,8,10-11".
+ * @param cpulist The cpu list to parse.
+ * @return The cpus of the list.
+ */
+inline std::vector<unsigned int> parse_cpulist(const std::string &cpulist)
+{
+    std::vector<unsigned int> cpus;
+    std::stringstream stream(cpulist);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        if (range.empty() || range[0] < '0' || range[0] > '9')
+            continue;
+        auto separator = range.find('-');
+        auto first = static_cast<unsigned int>(std::stoul(range));
+        auto last = separator == std::string::npos
+                        ? first
+                        : static_cast<unsigned int>(
+                              std::stoul(range.substr(separator + 1)));
+        for (auto cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+/**
+ * Returns all cpus as one node, used if the topology is unknown.
+ * @return The cpus of the system.
+ */
+inline std::vector<unsigned int> all_cpus()
+{
+    std::vector<unsigned int> cpus;
+    auto count = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int cpu = 0; cpu < count; ++cpu)
+        cpus.push_back(cpu);
+    return cpus;
+}
+
+/**
+ * Returns the cpus of a numa node.
+ * @param node The id of the numa node.
+ * @param root The sysfs directory of the numa nodes.
+ * @return The cpus of the node, empty if the node is unknown
+ * or has no cpus, like memory-only nodes.
+ */
+inline std::vector<unsigned int>
+numa_node_cpus(unsigned int node,
+               const std::string &root = "/sys/devices/system/node/")
+{
+    std::ifstream file(root + "node" + std::to_string(node) + "/cpulist");
+    std::string cpulist;
+    if (file && std::getline(file, cpulist))
+        return parse_cpulist(cpulist);
+    // Without a topology all cpus are on node 0
+    if (node == 0 && !std::ifstream(root + "online"))
+        return all_cpus();
+    return {};
+}
+
+/**
+ * Returns the cpus of each online numa node with cpus.
+ * The node ids may be sparse, nodes without cpus are skipped.
+ * If the topology is unknown, all cpus are assigned to one node.
+ * @param root The sysfs directory of the numa nodes.
+ * @return The cpus of each numa node.
+ */
+inline std::vector<std::vector<unsigned int>>
+numa_nodes(const std::string &root = "/sys/devices/system/node/")
+{
+    std::vector<std::vector<unsigned int>> nodes;
+    std::ifstream file(root + "online");
+    std::string online;
+    if (file && std::getline(file, online))
+    {
+        for (auto node : parse_cpulist(online))
+        {
+            auto cpus = numa_node_cpus(node, root);
+            if (!cpus.empty())
+                nodes.push_back(std::move(cpus));
+        }
+    }
+    if (nodes.empty())
+        nodes.push_back(all_cpus());
+    return nodes;
+}
+
+/**
+ * Reads the topology used by a placement policy,
+ * so it is read once rather than by each placed thread.
+ * @param placement The placement policy.
+ * @return The cpus of each numa node used by the policy.
+ */
+inline std::vector<std::vector<unsigned int>>
+placement_nodes(const thread_placement &placement)
+{
+    switch (placement.mode)
+    {
+        case placement_mode::compact:
+        case placement_mode::scatter:
+            return numa_nodes();
+        case placement_mode::numa_node:
+            return {numa_node_cpus(placement.node)};
+        default:
+            return {};
+    }
+}
+
+/**
+ * Returns the cpus a thread is allowed to run on.
+ * @param placement The placement policy.
+ * @param nodes The topology read by 'placement_nodes()'.
+ * @param index The index of the thread.
+ * @return The cpus to run on, empty if the thread is not placed.
+ */
+inline std::vector<unsigned int>
+placement_cpus(const thread_placement &placement,
+               const std::vector<std::vector<unsigned int>> &nodes,
+               unsigned int index)
+{
+    switch (placement.mode)
+    {
+        case placement_mode::cpus:
+        {
+            if (placement.cpus.empty())
+                return {};
+            return {placement.cpus[index % placement.cpus.size()]};
+        }
+        case placement_mode::compact:
+        {
+            std::vector<unsigned int> cpus;
+            for (const auto &node : nodes)
+                cpus.insert(cpus.end(), node.begin(), node.end());
+            if (cpus.empty())
+                return {};
+            return {cpus[index % cpus.size()]};
+        }
+        case placement_mode::scatter:
+        {
+            if (nodes.empty())
+                return {};
+            const auto &node = nodes[index % nodes.size()];
+            if (node.empty())
+                return {};
+            return {node[(index / nodes.size()) % node.size()]};
+        }
+        case placement_mode::numa_node:
+        {
+            if (nodes.empty())
+                return {};
+            return nodes[0];
+        }
+        default:
+            return {};
+    }
+}
+
+/**
+ * Places the calling thread by the placement policy.
+ * Memory touched first by the thread afterwards, for e.g.
+ * the session buffers, is allocated on its local numa node.
+ * @param placement The placement policy.
+ * @param nodes The topology read by 'placement_nodes()'.
+ * @param index The index of the thread.
+ * @return True if placed, false if not placed or not supported.
+ */
+inline bool apply_placement(const thread_placement &placement,
+                            const std::vector<std::vector<unsigned int>> &nodes,
+                            unsigned int index)
+{
+    auto cpus = placement_cpus(placement, nodes, index);
+    if (cpus.empty())
+        return false;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        RADRPC_LOG("apply_placement: Failed for thread " << index);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace detail
+} // namespace radrpc
+
+#endif // RADRPC_DETAIL_PLACEMENT_HPP
@@ -0,0 +1,207 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#ifndef RADRPC_DETAIL_TOKEN_BUCKET_HPP
+#define RADRPC_DETAIL_TOKEN_BUCKET_HPP
+
+#include <algorithm>
+#include <chrono>
+
+#include <radrpc/config.hpp>
+#include <radrpc/types.hpp>
+
+namespace radrpc {
+namespace detail {
+
+/**
+ * A bucket refilled with tokens at a steady rate up to its burst.
+ * Consuming more tokens than available goes into debt, so a request
+ * larger than the burst is delayed by its size instead of forever.
+ */
+class token_bucket
+{
+    double m_rate;     ///< The tokens per second, zero for unlimited.
+    double m_burst;    ///< The maximum tokens.
+    double m_tokens;   ///< The available tokens, negative if in debt.
+    time_point m_last; ///< The time of the last refill.
+
+    /**
+     * Adds the tokens since the last refill.
+     * @param now The current time.
+     */
+    void refill(time_point now)
+    {
+        if (now <= m_last)
+            return;
+        std::chrono::duration<double> elapsed = now - m_last;
+        m_tokens = (std::min)(m_burst, m_tokens + elapsed.count() * m_rate);
+        m_last = now;
+    }
+
+  public:
+    token_bucket() : m_rate(0), m_burst(0), m_tokens(0), m_last() {}
+
+    /**
+     * @param p_rate The tokens per second, zero for unlimited.
+     * @param p_burst The maximum tokens, zero for one second of the rate.
+     */
+    token_bucket(double p_rate, double p_burst) :
+        m_rate(p_rate),
+        m_burst(p_burst > 0 ? p_burst : p_rate),
+        m_tokens(m_burst),
+        m_last(std::chrono::steady_clock::now())
+    {
+    }
+
+    /**
+     * Checks whether the bucket limits anything.
+     * @return True if limited, false if unlimited.
+     */
+    bool enabled() const { return m_rate > 0; }
+
+    /**
+     * Returns the time until the tokens are available.
+     * @param tokens The tokens to consume.
+     * @param now The current time.
+     * @return The time to wait, zero if available.
+     */
+    duration wait_time(double tokens, time_point now)
+    {
+        if (!enabled())
+            return duration::zero();
+        refill(now);
+        auto needed = (std::min)(tokens, m_burst);
+        if (m_tokens >= needed)
+            return duration::zero();
+        return std::chrono::duration_cast<duration>(
+            std::chrono::duration<double>((needed - m_tokens) / m_rate));
+    }
+
+    /**
+     * Checks whether the bucket is refilled up to its burst.
+     * @param now The current time.
+     * @return True if full or unlimited, false if not.
+     */
+    bool full(time_point now)
+    {
+        if (!enabled())
+            return true;
+        refill(now);
+        return m_tokens >= m_burst;
+    }
+
+    /**
+     * Consumes the tokens, even if not available.
+     * @param tokens The tokens to consume.
+     */
+    void consume(double tokens)
+    {
+        if (enabled())
+            m_tokens -= tokens;
+    }
+
+    /**
+     * Gives back consumed tokens, up to the burst.
+     * @param tokens The tokens to give back.
+     */
+    void refund(double tokens)
+    {
+        if (enabled())
+            m_tokens = (std::min)(m_burst, m_tokens + tokens);
+    }
+
+    /**
+     * Changes the rate & the burst, the available tokens
+     * are kept up to the new burst.
+     * @param p_rate The tokens per second, zero for unlimited.
+     * @param p_burst The maximum tokens, zero for one second of the rate.
+     * @param now The current time.
+     */
+    void set_rate(double p_rate, double p_burst, time_point now)
+    {
+        if (!enabled())
+        {
+            *this = token_bucket(p_rate, p_burst);
+            return;
+        }
+        refill(now);
+        m_rate = p_rate;
+        m_burst = p_burst > 0 ? p_burst : p_rate;
+        m_tokens = (std::min)(m_burst, m_tokens);
+    }
+};
+
+/**
+ * Limits the requests & the received bytes with a bucket each.
+ */
+class rate_limiter
+{
+    token_bucket m_requests; ///< The bucket of the requests.
+    token_bucket m_bytes;    ///< The bucket of the received bytes.
+
+  public:
+    rate_limiter() = default;
+
+    /**
+     * @param limit The rates & bursts to apply.
+     */
+    explicit rate_limiter(const rate_limit &limit) :
+        m_requests(limit.requests_per_sec, limit.request_burst),
+        m_bytes(limit.bytes_per_sec, limit.byte_burst)
+    {
+    }
+
+    /**
+     * Checks whether the limiter limits anything.
+     * @return True if limited, false if unlimited.
+     */
+    bool enabled() const { return m_requests.enabled() || m_bytes.enabled(); }
+
+    /**
+     * Returns the time until a request can be dispatched.
+     * @param bytes The bytes of the request.
+     * @param now The current time.
+     * @return The time to wait, zero if it can be dispatched.
+     */
+    duration wait_time(std::size_t bytes, time_point now)
+    {
+        return (std::max)(m_requests.wait_time(1, now),
+                          m_bytes.wait_time(static_cast<double>(bytes), now));
+    }
+
+    /**
+     * Consumes the tokens of a request.
+     * @param bytes The bytes of the request.
+     */
+    void consume(std::size_t bytes)
+    {
+        m_requests.consume(1);
+        m_bytes.consume(static_cast<double>(bytes));
+    }
+};
+
+} // namespace detail
+} // namespace radrpc
+
+#endif // RADRPC_DETAIL_TOKEN_BUCKET_HPP
@@ -40,7 +40,9 @@
 #include <radrpc/debug.hpp>
 #include <radrpc/types.hpp>
 #include <radrpc/detail/data.hpp>
+#include <radrpc/detail/busy_poll.hpp>
 #include <radrpc/detail/operations.hpp>
+#include <radrpc/detail/placement.hpp>
 
 namespace radrpc {
 namespace impl {
@@ -53,8 +55,7 @@ template <typename T> class session_connect;
  */
 template <class Derived> class client_session
 {
-    boost::beast::flat_buffer
-        m_read_buffer;           ///< The buffer to receive bytes from server.
+    receive_buffer m_read_buffer; ///< The buffer to receive bytes from server.
     client_config *m_client_cfg; ///< The referenced client configuration.
     client_timeout *m_client_timeout; ///< The referenced client timeout.
     detail::data_cache m_cache;       ///< A cache to hold the server messages.
@@ -180,7 +181,7 @@ template <class Derived> class client_session
      */
     void read()
     {
-        derived().m_stream.async_read(m_read_buffer,
+        derived().m_stream.async_read(m_read_buffer.base(),
                                       std::bind(&client_session::on_read,
                                                 derived().shared_from_this(),
                                                 std::placeholders::_1,
@@ -202,19 +203,35 @@ template <class Derived> class client_session
             return;
         }
 
-        auto buffer_front = boost::beast::buffers_front(m_read_buffer.data());
+        auto buffer_front =
+            boost::beast::buffers_front(m_read_buffer.base().data());
         if (buffer_front.size() >= sizeof(detail::io_header))
         {
             auto header = reinterpret_cast<const detail::io_header *>(
                 buffer_front.data());
             auto func_itr = derived().m_bound_funcs->find(header->call_id);
             m_read_buffer.consume(sizeof(detail::io_header));
-            if (func_itr != derived().m_bound_funcs->end())
+            if (header->status !=
+                static_cast<uint32_t>(detail::io_status::ok))
+            {
+                // Notify with the empty response
+                RADRPC_LOG("client_session::on_read: Request "
+                           << (header->status ==
+                                       static_cast<uint32_t>(
+                                           detail::io_status::overloaded)
+                                   ? "shed, server overloaded"
+                                   : "rejected")
+                           << " [RID:" << header->result_id << "]");
+                m_cache.swap_notify(header->result_id,
+                                    m_read_buffer,
+                                    static_cast<detail::io_status>(
+                                        header->status));
+            }
+            else if (func_itr != derived().m_bound_funcs->end())
             {
                 // Call broadcast handler
                 if (func_itr->second)
-                    func_itr->second(
-                        *(reinterpret_cast<receive_buffer *>(&m_read_buffer)));
+                    func_itr->second(m_read_buffer);
             }
             else
             {
@@ -227,7 +244,7 @@ template <class Derived> class client_session
         }
 
         m_cache.remove_obsolete();
-        m_read_buffer.consume(m_read_buffer.size());
+        m_read_buffer.base().consume(m_read_buffer.base().size());
         read();
     }
 
@@ -493,6 +510,8 @@ class session_connect
             m_run_callback.set_value(false);
             return;
         }
+        detail::set_busy_poll(boost::beast::get_lowest_layer(m_stream).socket(),
+                              base().m_client_cfg->socket_busy_poll);
         boost::beast::get_lowest_layer(m_stream).expires_after(
             base().m_client_timeout->handshake_timeout);
         ssl_handshake();
@@ -715,9 +734,13 @@ class session_connect
                                              this->shared_from_this()));
 
         *m_thread = std::thread([&] {
+            const auto &placement = base().m_client_cfg->placement;
+            detail::apply_placement(
+                placement, detail::placement_nodes(placement), 0);
             if (m_io_ctx->stopped())
                 m_io_ctx->restart();
-            m_io_ctx->run();
+            detail::run_busy_poll(*m_io_ctx,
+                                  base().m_client_cfg->spin_budget);
             RADRPC_LOG("session_connect::run: IO done");
         });
 
@@ -0,0 +1,134 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#ifndef RADRPC_IMPL_SERVER_ADMISSION_HPP
+#define RADRPC_IMPL_SERVER_ADMISSION_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include <radrpc/debug.hpp>
+#include <radrpc/types.hpp>
+
+namespace radrpc {
+namespace impl {
+namespace server {
+
+/**
+ * Sheds requests by their sojourn time, the time from receiving
+ * a request until it is dispatched, similar to CoDel.
+ * If the smallest sojourn time within an interval stayed above the
+ * target, the server is overloaded for the next interval & requests
+ * waiting more than twice the target are rejected. Requests which
+ * are dispatched quickly are still admitted, so the queue drains.
+ * The state is kept in atomics, since each request on each
+ * worker passes it, the thread ending an interval evaluates it.
+ */
+class admission_control
+{
+    typedef duration::rep ticks; ///< The time in steady clock ticks.
+
+    const duration m_target;   ///< The acceptable sojourn time.
+    const duration m_interval; ///< The interval to measure the minimum.
+    std::atomic<ticks> m_interval_end; ///< The end of the current interval.
+    std::atomic<ticks> m_min_sojourn;  ///< The minimum within the interval.
+    std::atomic<bool> m_overloaded; ///< Whether the last interval was
+                                    ///< overloaded.
+    std::atomic<uint64_t> m_admitted; ///< The total admitted requests.
+    std::atomic<uint64_t> m_shed;     ///< The total rejected requests.
+
+  public:
+    /**
+     * @param p_target The acceptable sojourn time, zero to admit all.
+     * @param p_interval The interval to measure the minimum sojourn time.
+     */
+    admission_control(duration p_target, duration p_interval) :
+        m_target(p_target),
+        m_interval(p_interval),
+        m_interval_end(0),
+        m_min_sojourn(duration::max().count()),
+        m_overloaded(false),
+        m_admitted(0),
+        m_shed(0)
+    {
+    }
+
+    /**
+     * Checks whether requests are measured.
+     * @return True if enabled, false if all requests are admitted.
+     */
+    bool enabled() const { return m_target != duration::zero(); }
+
+    /**
+     * Decides whether to dispatch a request.
+     * [thread-safe]
+     * @param received The time the request was received.
+     * @return True if the request should be dispatched,
+     * false if it should be rejected as overloaded.
+     */
+    bool admit(time_point received)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto sojourn = (now - received).count();
+        auto now_ticks = now.time_since_epoch().count();
+        auto interval_end = m_interval_end.load(std::memory_order_relaxed);
+        if (now_ticks >= interval_end &&
+            m_interval_end.compare_exchange_strong(
+                interval_end, now_ticks + m_interval.count()))
+        {
+            auto min_sojourn = m_min_sojourn.exchange(duration::max().count());
+            m_overloaded.store(min_sojourn != duration::max().count() &&
+                                   min_sojourn > m_target.count(),
+                               std::memory_order_relaxed);
+        }
+        auto min_sojourn = m_min_sojourn.load(std::memory_order_relaxed);
+        while (sojourn < min_sojourn &&
+               !m_min_sojourn.compare_exchange_weak(min_sojourn, sojourn))
+        {
+        }
+        if (m_overloaded.load(std::memory_order_relaxed) &&
+            sojourn > 2 * m_target.count())
+        {
+            ++m_shed;
+            return false;
+        }
+        ++m_admitted;
+        return true;
+    }
+
+    /**
+     * Returns the current statistics.
+     * @return The statistics.
+     */
+    admission_stats stats()
+    {
+        return admission_stats{m_overloaded, m_admitted, m_shed};
+    }
+};
+
+} // namespace server
+} // namespace impl
+} // namespace radrpc
+
+#endif // RADRPC_IMPL_SERVER_ADMISSION_HPP
@@ -0,0 +1,178 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#ifndef RADRPC_IMPL_SERVER_BULKHEAD_HPP
+#define RADRPC_IMPL_SERVER_BULKHEAD_HPP
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include <radrpc/debug.hpp>
+#include <radrpc/types.hpp>
+
+namespace radrpc {
+
+class session_context;
+
+namespace impl {
+namespace server {
+
+/**
+ * Limits the concurrent executions of a bound handler
+ * & queues or rejects the requests exceeding this limit.
+ * @see radrpc::call_policy
+ */
+class bulkhead
+{
+    const call_policy m_policy; ///< The policy to apply.
+    std::mutex m_mtx;           ///< Lock, since it is shared among sessions.
+    unsigned int m_executing;   ///< The current executions.
+    uint64_t m_executed;        ///< The total executions.
+    uint64_t m_rejected;        ///< The total rejected requests.
+    uint64_t m_generation;      ///< The slots handed out since 'clear()'.
+    std::deque<std::function<void(uint64_t)>>
+        m_waiting; ///< The handlers waiting for a free slot.
+
+  public:
+    /**
+     * The result of 'acquire()'.
+     */
+    enum class result
+    {
+        acquired, ///< A slot was acquired, the caller may execute.
+        queued,   ///< The resume handler will be called with a slot.
+        rejected, ///< No slot available, the caller should reject.
+    };
+
+    /**
+     * @param p_policy The policy to apply.
+     */
+    explicit bulkhead(const call_policy &p_policy) :
+        m_policy(p_policy),
+        m_executing(0),
+        m_executed(0),
+        m_rejected(0),
+        m_generation(0)
+    {
+    }
+
+    /**
+     * Tries to acquire an execution slot.
+     * If queued, the resume handler will be called later by 'release()'
+     * which passes the slot with its generation over to the handler.
+     * @param resume_handler The handler to call if a queued slot is free.
+     * @param generation The generation of the acquired slot,
+     * which is passed to 'release()'.
+     * @return The result of the acquisition.
+     */
+    template <typename Handler>
+    result acquire(Handler &&resume_handler, uint64_t &generation)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (m_executing < m_policy.max_concurrent)
+        {
+            ++m_executing;
+            generation = m_generation;
+            return result::acquired;
+        }
+        if (m_policy.overflow == overflow_action::queue &&
+            m_waiting.size() < m_policy.max_queued)
+        {
+            m_waiting.emplace_back(std::forward<Handler>(resume_handler));
+            return result::queued;
+        }
+        ++m_rejected;
+        return result::rejected;
+    }
+
+    /**
+     * Releases an execution slot & passes
+     * it over to the next queued handler.
+     * Slots handed out before 'clear()' are already released.
+     * @param generation The generation of the slot.
+     */
+    void release(uint64_t generation)
+    {
+        std::function<void(uint64_t)> next;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            ++m_executed;
+            if (generation != m_generation)
+                return;
+            if (m_waiting.empty())
+            {
+                --m_executing;
+                return;
+            }
+            next = std::move(m_waiting.front());
+            m_waiting.pop_front();
+        }
+        next(generation);
+    }
+
+    /**
+     * Removes all queued handlers without calling them & releases
+     * all slots, including the ones passed to handlers which are
+     * not called anymore, so the limit is restored for a restart.
+     */
+    void clear()
+    {
+        std::deque<std::function<void(uint64_t)>> waiting;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            waiting.swap(m_waiting);
+            m_executing = 0;
+            ++m_generation;
+        }
+        RADRPC_LOG("bulkhead::clear: " << waiting.size() << " handlers");
+    }
+
+    /**
+     * Returns the current statistics.
+     * @return The statistics.
+     */
+    call_stats stats()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        return call_stats{m_executing, m_waiting.size(), m_executed, m_rejected};
+    }
+};
+
+/**
+ * A handler bound to a call id with its optional limit.
+ */
+struct bound_func
+{
+    std::function<void(session_context *)> handler; ///< The bound handler.
+    std::shared_ptr<bulkhead> limit; ///< The limit, nullptr if unlimited.
+};
+
+} // namespace server
+} // namespace impl
+} // namespace radrpc
+
+#endif // RADRPC_IMPL_SERVER_BULKHEAD_HPP
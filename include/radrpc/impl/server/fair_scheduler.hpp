@@ -0,0 +1,228 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#ifndef RADRPC_IMPL_SERVER_FAIR_SCHEDULER_HPP
+#define RADRPC_IMPL_SERVER_FAIR_SCHEDULER_HPP
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <radrpc/debug.hpp>
+
+namespace radrpc {
+namespace impl {
+namespace server {
+
+/**
+ * Limits the concurrent handler executions of all sessions & passes
+ * the free slots to the waiting requests by deficit round robin.
+ * Each tenant gets slots in proportion to its weight, regardless of
+ * how many requests or sessions it has waiting.
+ */
+class fair_scheduler
+{
+    /**
+     * The waiting requests of a tenant.
+     */
+    struct flow
+    {
+        std::deque<std::function<void(uint64_t)>>
+            waiting;         ///< The handlers waiting for a free slot.
+        unsigned int weight; ///< The slots per round, set by the first
+                             ///< request queued at the tenant.
+        unsigned int deficit; ///< The slots left in the current round.
+        bool visited; ///< Whether the weight was added in this round.
+    };
+
+    const unsigned int m_max_concurrent; ///< The maximum executions.
+    std::mutex m_mtx;         ///< Lock, since it is shared among sessions.
+    unsigned int m_executing; ///< The current executions.
+    uint64_t m_generation;    ///< The slots handed out since 'clear()'.
+    std::unordered_map<std::string, flow> m_flows; ///< The waiting tenants.
+    std::deque<std::string> m_active; ///< The round of the waiting tenants.
+
+    /**
+     * Takes the next handler by deficit round robin.
+     * @return The handler, empty if nothing is waiting.
+     */
+    std::function<void(uint64_t)> next()
+    {
+        while (!m_active.empty())
+        {
+            auto flow_itr = m_flows.find(m_active.front());
+            auto &f = flow_itr->second;
+            if (!f.visited)
+            {
+                f.deficit += f.weight;
+                f.visited = true;
+            }
+            if (f.deficit == 0)
+            {
+                f.visited = false;
+                m_active.push_back(std::move(m_active.front()));
+                m_active.pop_front();
+                continue;
+            }
+            --f.deficit;
+            auto handler = std::move(f.waiting.front());
+            f.waiting.pop_front();
+            if (f.waiting.empty())
+            {
+                m_flows.erase(flow_itr);
+                m_active.pop_front();
+            }
+            return handler;
+        }
+        return nullptr;
+    }
+
+  public:
+    /**
+     * The result of 'acquire()'.
+     */
+    enum class result
+    {
+        acquired, ///< A slot was acquired, the caller may execute.
+        queued,   ///< The resume handler will be called with a slot.
+    };
+
+    /**
+     * @param p_max_concurrent The maximum executions, zero to disable.
+     */
+    explicit fair_scheduler(unsigned int p_max_concurrent) :
+        m_max_concurrent(p_max_concurrent),
+        m_executing(0),
+        m_generation(0)
+    {
+    }
+
+    /**
+     * Checks whether the executions are scheduled.
+     * @return True if enabled, false if executed in arrival order.
+     */
+    bool enabled() const { return m_max_concurrent != 0; }
+
+    /**
+     * Tries to acquire an execution slot.
+     * If queued, the resume handler will be called later by 'release()'
+     * which passes the slot with its generation over to the handler.
+     * The weight of a tenant is taken from the request which queued
+     * first at it, the weights of later requests are ignored until
+     * all requests of the tenant were passed a slot.
+     * @param tenant The tenant to queue the request at.
+     * @param weight The weight of the tenant, at least one.
+     * @param resume_handler The handler to call if a queued slot is free.
+     * @param generation The generation of the acquired slot,
+     * which is passed to 'release()'.
+     * @return The result of the acquisition.
+     */
+    template <typename Handler>
+    result acquire(const std::string &tenant,
+                   unsigned int weight,
+                   Handler &&resume_handler,
+                   uint64_t &generation)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (m_executing < m_max_concurrent)
+        {
+            ++m_executing;
+            generation = m_generation;
+            return result::acquired;
+        }
+        auto flow_itr = m_flows.find(tenant);
+        if (flow_itr == m_flows.end())
+        {
+            flow_itr = m_flows.emplace(tenant, flow{{}, 0, 0, false}).first;
+            flow_itr->second.weight = weight == 0 ? 1 : weight;
+            m_active.push_back(tenant);
+        }
+        flow_itr->second.waiting.emplace_back(
+            std::forward<Handler>(resume_handler));
+        return result::queued;
+    }
+
+    /**
+     * Releases an execution slot & passes it over
+     * to the next handler by deficit round robin.
+     * Slots handed out before 'clear()' are already released.
+     * @param generation The generation of the slot.
+     */
+    void release(uint64_t generation)
+    {
+        std::function<void(uint64_t)> handler;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            if (generation != m_generation)
+                return;
+            handler = next();
+            if (!handler)
+            {
+                --m_executing;
+                return;
+            }
+        }
+        handler(generation);
+    }
+
+    /**
+     * Removes all queued handlers without calling them & releases
+     * all slots, including the ones passed to handlers which are
+     * not called anymore, so the limit is restored for a restart.
+     */
+    void clear()
+    {
+        std::unordered_map<std::string, flow> flows;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            flows.swap(m_flows);
+            m_active.clear();
+            m_executing = 0;
+            ++m_generation;
+        }
+        RADRPC_LOG("fair_scheduler::clear: " << flows.size() << " tenants");
+    }
+
+    /**
+     * Returns the amount of waiting requests.
+     * @return The waiting requests of all tenants.
+     */
+    std::size_t waiting()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        std::size_t count = 0;
+        for (const auto &f : m_flows)
+            count += f.second.waiting.size();
+        return count;
+    }
+};
+
+} // namespace server
+} // namespace impl
+} // namespace radrpc
+
+#endif // RADRPC_IMPL_SERVER_FAIR_SCHEDULER_HPP
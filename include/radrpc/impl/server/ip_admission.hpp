@@ -0,0 +1,363 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#ifndef RADRPC_IMPL_SERVER_IP_ADMISSION_HPP
+#define RADRPC_IMPL_SERVER_IP_ADMISSION_HPP
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <radrpc/config.hpp>
+#include <radrpc/debug.hpp>
+#include <radrpc/types.hpp>
+#include <radrpc/detail/cidr_trie.hpp>
+#include <radrpc/detail/token_bucket.hpp>
+
+namespace radrpc {
+namespace impl {
+namespace server {
+
+/**
+ * Admits the accepted connections by their binary address.
+ * The ranges are matched in a trie & the open connections & the
+ * accept bucket of each address are kept in an open addressed table,
+ * so neither admissions nor rejections allocate.
+ * The rules are replaced as a whole & can be changed at runtime.
+ * @see radrpc::ip_policy
+ */
+class ip_admission : public std::enable_shared_from_this<ip_admission>
+{
+  public:
+    /**
+     * The reference a session holds while open, it counts the
+     * sessions of the io context & releases the connection of the
+     * admitted address on destruction.
+     */
+    class connection_ref
+    {
+        std::shared_ptr<void>
+            m_io_ref; ///< Counts the sessions of the used io context.
+        std::shared_ptr<ip_admission>
+            m_filter;            ///< The filter which admitted the address.
+        detail::ip_bytes m_address; ///< The admitted address.
+
+        friend class ip_admission;
+
+      public:
+        /**
+         * @param p_io_ref The reference counting the sessions of the
+         * io context.
+         */
+        explicit connection_ref(std::shared_ptr<void> p_io_ref = nullptr) :
+            m_io_ref(std::move(p_io_ref)),
+            m_address()
+        {
+        }
+
+        connection_ref(connection_ref &&) = default;
+
+        connection_ref &operator=(connection_ref &&) = delete;
+
+        ~connection_ref()
+        {
+            if (m_filter)
+                m_filter->release(m_address);
+        }
+    };
+
+  private:
+    /**
+     * The parsed policy.
+     */
+    struct rules
+    {
+        detail::cidr_trie ranges; ///< 1 for allowed, 0 for denied ranges.
+        bool accept_unmatched;    ///< Accept addresses in no range.
+        unsigned int max_connections; ///< The connections per address.
+        double accepts_per_sec;       ///< The accept rate per address.
+        double accept_burst;          ///< The accept burst per address.
+    };
+
+    /**
+     * The slot of an address in the table.
+     */
+    struct address_entry
+    {
+        detail::ip_bytes address;     ///< The address.
+        bool used;                    ///< Whether the slot holds an address.
+        unsigned int connections;     ///< The open connections.
+        detail::token_bucket accepts; ///< The bucket of the accepts.
+    };
+
+    std::shared_ptr<const rules> m_rules; ///< The current rules.
+    std::mutex m_mtx; ///< Lock, since it is shared among acceptors.
+    std::vector<address_entry>
+        m_table;        ///< The slots, linear probed & a power of two.
+    std::size_t m_used; ///< The used slots of the table.
+
+    /**
+     * Parses a policy.
+     * @param policy The policy to parse.
+     * @return The rules, nullptr if a range is invalid.
+     */
+    static std::shared_ptr<const rules> parse(const ip_policy &policy)
+    {
+        auto parsed = std::make_shared<rules>();
+        parsed->accept_unmatched = policy.allow.empty();
+        parsed->max_connections = policy.max_connections;
+        parsed->accepts_per_sec = policy.accepts_per_sec;
+        parsed->accept_burst = policy.accept_burst;
+        for (int value = 0; value < 2; ++value)
+        {
+            for (const auto &range : value == 0 ? policy.deny : policy.allow)
+            {
+                detail::ip_bytes bytes;
+                unsigned int length;
+                if (!detail::parse_cidr(range, bytes, length))
+                {
+                    RADRPC_LOG("ip_admission::parse: Invalid range " << range);
+                    return nullptr;
+                }
+                parsed->ranges.insert(bytes, length, value);
+            }
+        }
+        return parsed;
+    }
+
+    /**
+     * Hashes the bytes of an address.
+     * @param bytes The address.
+     * @return The hash.
+     */
+    static std::size_t hash(const detail::ip_bytes &bytes)
+    {
+        uint64_t high, low;
+        std::memcpy(&high, bytes.data(), sizeof(high));
+        std::memcpy(&low, bytes.data() + sizeof(high), sizeof(low));
+        return std::hash<uint64_t>()(high ^ (low * 0x9E3779B97F4A7C15ull));
+    }
+
+    /**
+     * Finds the slot of an address.
+     * @param bytes The address.
+     * @return The index of the address, or of the free slot to insert it.
+     */
+    std::size_t find(const detail::ip_bytes &bytes) const
+    {
+        auto mask = m_table.size() - 1;
+        auto index = hash(bytes) & mask;
+        while (m_table[index].used && m_table[index].address != bytes)
+            index = (index + 1) & mask;
+        return index;
+    }
+
+    /**
+     * Frees a slot & shifts the following addresses
+     * back, so no probe sequence is interrupted.
+     * @param index The slot to free.
+     */
+    void erase(std::size_t index)
+    {
+        auto mask = m_table.size() - 1;
+        for (auto next = (index + 1) & mask; m_table[next].used;
+             next = (next + 1) & mask)
+        {
+            auto home = hash(m_table[next].address) & mask;
+            if (((next - home) & mask) >= ((next - index) & mask))
+            {
+                m_table[index] = m_table[next];
+                index = next;
+            }
+        }
+        m_table[index].used = false;
+        --m_used;
+    }
+
+    /**
+     * Rebuilds the table without the addresses lacking connections
+     * whose accept bucket refilled completely. The table grows if
+     * it would be filled by a quarter afterwards.
+     * @param now The current time.
+     */
+    void sweep(time_point now)
+    {
+        std::size_t kept = 0;
+        for (auto &entry : m_table)
+        {
+            if (!entry.used)
+                continue;
+            if (entry.connections == 0 && entry.accepts.full(now))
+                entry.used = false;
+            else
+                ++kept;
+        }
+        auto size = m_table.size();
+        while ((kept + 1) * 4 > size)
+            size *= 2;
+        std::vector<address_entry> table(size, address_entry());
+        table.swap(m_table);
+        for (auto &entry : table)
+        {
+            if (entry.used)
+                m_table[find(entry.address)] = entry;
+        }
+        m_used = kept;
+    }
+
+    /**
+     * Releases a connection of an address.
+     * @param bytes The address.
+     */
+    void release(const detail::ip_bytes &bytes)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        auto index = find(bytes);
+        auto &entry = m_table[index];
+        if (!entry.used)
+            return;
+        if (--entry.connections == 0 && !entry.accepts.enabled())
+            erase(index);
+    }
+
+  public:
+    /**
+     * @param policy The initial policy, not applied if invalid.
+     */
+    explicit ip_admission(const ip_policy &policy) :
+        m_rules(parse(policy)),
+        m_table(config::ip_table_slots, address_entry()),
+        m_used(0)
+    {
+        if (!m_rules)
+            m_rules = parse(ip_policy());
+    }
+
+    /**
+     * Replaces the policy, the open connections & the available
+     * accepts of each address are kept.
+     * [thread-safe]
+     * @param policy The policy to apply.
+     * @return True if applied, false if a range is invalid.
+     */
+    bool set(const ip_policy &policy)
+    {
+        auto parsed = parse(policy);
+        if (!parsed)
+            return false;
+        std::unique_lock<std::mutex> lock(m_mtx);
+        auto now = std::chrono::steady_clock::now();
+        for (auto &entry : m_table)
+        {
+            if (entry.used)
+                entry.accepts.set_rate(
+                    parsed->accepts_per_sec, parsed->accept_burst, now);
+        }
+        std::atomic_store(&m_rules, parsed);
+        return true;
+    }
+
+    /**
+     * Decides whether to accept a connection.
+     * The connections of each address are counted, even without a
+     * limit, so a limit applied later includes the open ones.
+     * [thread-safe]
+     * @param address The address of the connection.
+     * @param ref The reference the session holds while open,
+     * which releases the connection if accepted.
+     * @return True if accepted, false if rejected.
+     */
+    bool admit(const boost::asio::ip::address &address, connection_ref &ref)
+    {
+        auto current = std::atomic_load(&m_rules);
+        auto bytes = detail::to_ip_bytes(address);
+        auto value = current->ranges.match(bytes);
+        if (value == 0 || (value < 0 && !current->accept_unmatched))
+            return false;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            auto now = std::chrono::steady_clock::now();
+            auto index = find(bytes);
+            if (!m_table[index].used)
+            {
+                if ((m_used + 1) * 2 > m_table.size())
+                {
+                    sweep(now);
+                    index = find(bytes);
+                }
+                m_table[index] = address_entry{
+                    bytes,
+                    true,
+                    0,
+                    detail::token_bucket(current->accepts_per_sec,
+                                         current->accept_burst)};
+                ++m_used;
+            }
+            auto &entry = m_table[index];
+            if ((current->max_connections != 0 &&
+                 entry.connections >= current->max_connections) ||
+                entry.accepts.wait_time(1, now) != duration::zero())
+                return false;
+            entry.accepts.consume(1);
+            ++entry.connections;
+        }
+        if (ref.m_filter)
+            ref.m_filter->release(ref.m_address);
+        ref.m_filter = shared_from_this();
+        ref.m_address = bytes;
+        return true;
+    }
+
+    /**
+     * Gives back the accept of an admitted connection
+     * which was rejected afterwards.
+     * [thread-safe]
+     * @param address The address of the connection.
+     */
+    void refund(const boost::asio::ip::address &address)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        auto &entry = m_table[find(detail::to_ip_bytes(address))];
+        if (entry.used)
+            entry.accepts.refund(1);
+    }
+
+    /**
+     * @return The amount of addresses with state.
+     */
+    std::size_t addresses()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        return m_used;
+    }
+};
+
+} // namespace server
+} // namespace impl
+} // namespace radrpc
+
+#endif // RADRPC_IMPL_SERVER_IP_ADMISSION_HPP
@@ -25,21 +25,41 @@
 #ifndef RADRPC_IMPL_SERVER_LISTENER_HPP
 #define RADRPC_IMPL_SERVER_LISTENER_HPP
 
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <utility>
+#include <vector>
 
 #include <boost/asio/strand.hpp>
 
 #include <radrpc/config.hpp>
 #include <radrpc/debug.hpp>
 #include <radrpc/types.hpp>
+#include <radrpc/detail/busy_poll.hpp>
 #include <radrpc/impl/server/server_session.hpp>
+#include <radrpc/impl/server/timer_wheel.hpp>
 
 namespace radrpc {
 namespace impl {
 namespace server {
 
+/**
+ * An io context to run sessions on.
+ */
+struct io_slot
+{
+    boost::asio::io_context *io_ctx; ///< The io context to run sessions on.
+    std::shared_ptr<char> sessions;  ///< Referenced by each session on it.
+    std::weak_ptr<timer_wheel> wheel; ///< The timer wheel of the sessions.
+};
+
+#ifdef SO_REUSEPORT
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+    reuse_port; ///< Allows multiple acceptors on the same endpoint.
+#endif
+
 /**
  * Accepts incoming requests & create sessions.
  */
@@ -49,83 +69,276 @@ class listener : public std::enable_shared_from_this<listener>
     ssl::context *m_ssl_ctx;
 #endif
     boost::asio::io_context &m_io_ctx; ///< The referenced io context.
-    tcp::acceptor m_acceptor; ///< Accept for listening to new connections.
+    std::vector<std::shared_ptr<tcp::acceptor>>
+        m_acceptors; ///< Acceptors for listening to new connections.
+    std::vector<io_slot> m_slots; ///< The io contexts to pin sessions to.
     const server_config &m_server_cfg;      ///< The referenced server config.
     const server_timeout &m_server_timeout; ///< The referenced server timeout.
     const session_config &m_session_cfg;    ///< The referenced session config.
+    std::weak_ptr<timer_wheel>
+        m_wheel;         ///< The timer wheel of the sessions without slots.
+    std::mutex m_wheel_mtx; ///< Lock for creating the timer wheels.
+
+    /**
+     * Returns the timer wheel of an io context & creates it if
+     * no session is using it. The wheel is only referenced by the
+     * sessions & its pending tick, so it is destroyed along with
+     * its io context.
+     * @param wheel The wheel of the io context.
+     * @param io_ctx The io context to tick on.
+     * @return The timer wheel.
+     */
+    std::shared_ptr<timer_wheel> wheel_of(std::weak_ptr<timer_wheel> &wheel,
+                                          boost::asio::io_context &io_ctx)
+    {
+        std::unique_lock<std::mutex> lock(m_wheel_mtx);
+        auto current = wheel.lock();
+        if (current)
+            return current;
+        current = std::make_shared<timer_wheel>(
+            io_ctx.get_executor(), m_server_cfg.timer_resolution);
+        wheel = current;
+        return current;
+    }
+
+    /**
+     * Returns the io context with the fewest sessions.
+     * @return The least loaded io context.
+     */
+    io_slot &least_loaded_slot()
+    {
+        auto slot = m_slots.begin();
+        for (auto itr = m_slots.begin() + 1; itr != m_slots.end(); ++itr)
+            if (itr->sessions.use_count() < slot->sessions.use_count())
+                slot = itr;
+        return *slot;
+    }
+
+    /**
+     * Returns the amount of acceptors to open.
+     * @param p_server_cfg The server config.
+     * @return The amount of acceptors.
+     */
+    static std::size_t acceptor_count(const server_config &p_server_cfg)
+    {
+#ifdef SO_REUSEPORT
+        if (p_server_cfg.reuse_port && p_server_cfg.workers > 1)
+            return p_server_cfg.workers;
+#endif
+        return 1;
+    }
+
+    /**
+     * Opens, binds & listens with the acceptor.
+     * @param acceptor The acceptor to open.
+     * @param endpoint The endpoint to bind.
+     * @param shared Whether other acceptors share the endpoint.
+     */
+    static void open_acceptor(tcp::acceptor &acceptor,
+                              const tcp::endpoint &endpoint,
+                              bool shared)
+    {
+        boost::system::error_code ec;
+        acceptor.open(endpoint.protocol(), ec);
+        if (ec)
+        {
+            RADRPC_LOG("+listener:: Acceptor open failed\n" << ec.message());
+            return;
+        }
+
+        acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
+        if (ec)
+        {
+            RADRPC_LOG("+listener:: Acceptor set option failed\n"
+                       << ec.message());
+            acceptor.close();
+            return;
+        }
+
+#ifdef SO_REUSEPORT
+        if (shared)
+        {
+            acceptor.set_option(reuse_port(true), ec);
+            if (ec)
+            {
+                RADRPC_LOG("+listener:: Acceptor set reuse port failed\n"
+                           << ec.message());
+                acceptor.close();
+                return;
+            }
+        }
+#endif
+
+        acceptor.bind(endpoint, ec);
+        if (ec)
+        {
+            RADRPC_LOG("+listener:: Acceptor bind failed\n" << ec.message());
+            acceptor.close();
+            return;
+        }
+
+        acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+        if (ec)
+        {
+            RADRPC_LOG("+listener:: Acceptor listen failed\n" << ec.message());
+            acceptor.close();
+            return;
+        }
+    }
 
     /**
      * Accept new connections.
+     * If io contexts were passed, the connection is pinned to the
+     * acceptor's own io context if each worker got an acceptor,
+     * otherwise to the least loaded one. Without io contexts
+     * a strand is used.
+     * The acceptor is only referenced by its pending accepts,
+     * so it is destroyed along with its own io context.
      * This function must be called within the executor context.
+     * @param acceptor The acceptor to use.
+     * @param index The index of the acceptor.
      */
-    void handle_accept()
+    void handle_accept(const std::shared_ptr<tcp::acceptor> &acceptor,
+                       std::size_t index)
     {
-        if (!m_acceptor.is_open())
+        if (!acceptor->is_open())
             return;
-        RADRPC_LOG("listener::handle_accept");
-        m_acceptor.async_accept(boost::asio::make_strand(m_io_ctx),
-                                boost::beast::bind_front_handler(
-                                    &listener::on_accept, shared_from_this()));
+        RADRPC_LOG("listener::handle_accept: " << index);
+        if (m_slots.empty())
+        {
+            acceptor->async_accept(
+                boost::asio::make_strand(m_io_ctx),
+                boost::beast::bind_front_handler(&listener::on_accept,
+                                                 shared_from_this(),
+                                                 acceptor,
+                                                 index,
+                                                 std::shared_ptr<void>(),
+                                                 wheel_of(m_wheel, m_io_ctx)));
+            return;
+        }
+        auto &slot = acceptor_count(m_server_cfg) == m_slots.size()
+                         ? m_slots[index]
+                         : least_loaded_slot();
+        acceptor->async_accept(
+            slot.io_ctx->get_executor(),
+            boost::beast::bind_front_handler(&listener::on_accept,
+                                             shared_from_this(),
+                                             acceptor,
+                                             index,
+                                             std::shared_ptr<void>(
+                                                 slot.sessions),
+                                             wheel_of(slot.wheel,
+                                                      *slot.io_ctx)));
     }
 
     /**
      *
+     * @param acceptor The acceptor which accepted the connection.
+     * @param index The index of the acceptor.
+     * @param io_ref The reference counting the sessions of the io context.
+     * @param wheel The timer wheel of the io context.
      * @param ec
      * @param socket
      */
-    void on_accept(boost::system::error_code ec, tcp::socket socket)
+    void on_accept(std::shared_ptr<tcp::acceptor> acceptor,
+                   std::size_t index,
+                   std::shared_ptr<void> io_ref,
+                   std::shared_ptr<timer_wheel> wheel,
+                   boost::system::error_code ec,
+                   tcp::socket socket)
     {
         if (ec == boost::asio::error::operation_aborted)
             return;
+        // Re-arm before creating the session to keep the
+        // amount of outstanding accepts during connection bursts.
+        handle_accept(acceptor, index);
         if (ec)
         {
             RADRPC_LOG("listener::on_accept: " << ec.message());
+            return;
         }
-        else
+        // Rejected by the binary address before anything is allocated,
+        // the address is only converted if a listen handler was bound.
+        auto endpoint = socket.remote_endpoint(ec);
+        ip_admission::connection_ref ref(std::move(io_ref));
+        auto admitted =
+            !ec && manager->ip_filter->admit(endpoint.address(), ref);
+        if (!admitted ||
+            (manager->on_listen &&
+             !manager->on_listen(endpoint.address().to_string())) ||
+            manager->is_full())
         {
-            if ((manager->on_listen &&
-                 !manager->on_listen(
-                     socket.remote_endpoint(ec).address().to_string())) ||
-                ec || manager->is_full())
-            {
-                RADRPC_LOG("listener::on_accept: Rejected connection: "
-                           << ec.message());
-                socket.close();
-            }
-            else
-            {
-                RADRPC_LOG(
-                    "listener::on_accept: Create & run new server_session");
+            // Rejected after the admission, so the accept isn't counted
+            if (admitted)
+                manager->ip_filter->refund(endpoint.address());
+            RADRPC_LOG("listener::on_accept: Rejected connection: "
+                       << ec.message());
+            socket.close();
+            return;
+        }
+        detail::set_busy_poll(socket, m_server_cfg.socket_busy_poll);
+        if (m_slots.empty() || acceptor_count(m_server_cfg) == m_slots.size())
+        {
+            run_session(std::move(socket), std::move(ref), std::move(wheel));
+            return;
+        }
+        // Created by the worker of its io context rather than the
+        // acceptor, so the session is allocated on its numa node.
+        auto executor = socket.get_executor();
+        boost::asio::post(executor,
+                          [self = shared_from_this(),
+                           socket = std::move(socket),
+                           ref = std::move(ref),
+                           wheel = std::move(wheel)]() mutable {
+                              self->run_session(std::move(socket),
+                                                std::move(ref),
+                                                std::move(wheel));
+                          });
+    }
+
+    /**
+     * Creates & runs the session of an accepted connection.
+     * This function must be called within the executor of the socket.
+     * @param socket The accepted connection.
+     * @param io_ref The reference counting the sessions of the io context
+     * & the connections of the address.
+     * @param wheel The timer wheel of the io context.
+     */
+    void run_session(tcp::socket socket,
+                     ip_admission::connection_ref io_ref,
+                     std::shared_ptr<timer_wheel> wheel)
+    {
+        RADRPC_LOG("listener::run_session: Create & run new server_session");
 #ifdef RADRPC_SSL_SUPPORT
-                if (m_ssl_ctx)
-                {
-                    // Detect session and create plain or ssl session
-                    std::make_shared<detect_session>(std::move(socket),
-                                                     *m_ssl_ctx,
-                                                     m_server_cfg,
-                                                     m_server_timeout,
-                                                     m_session_cfg,
-                                                     manager)
-                        ->run();
-                }
-                else
+        if (m_ssl_ctx)
+        {
+            // Detect session and create plain or ssl session
+            std::make_shared<detect_session>(std::move(socket),
+                                             *m_ssl_ctx,
+                                             m_server_cfg,
+                                             m_server_timeout,
+                                             m_session_cfg,
+                                             manager,
+                                             std::move(io_ref),
+                                             std::move(wheel))
+                ->run();
+        }
+        else
 #endif
-                {
-                    // Create plain session only
-                    boost::beast::flat_buffer buffer;
-                    buffer.max_size(manager->server_cfg.max_handshake_bytes);
-                    std::make_shared<
-                        session_accept<server_streams::plain_stream>>(
-                        boost::beast::tcp_stream(std::move(socket)),
-                        std::move(buffer),
-                        manager,
-                        m_server_timeout,
-                        m_session_cfg)
-                        ->accept();
-                }
-            }
+        {
+            // Create plain session only
+            boost::beast::flat_buffer buffer;
+            buffer.max_size(manager->server_cfg.max_handshake_bytes);
+            std::make_shared<session_accept<server_streams::plain_stream>>(
+                boost::beast::tcp_stream(std::move(socket)),
+                std::move(buffer),
+                manager,
+                m_server_timeout,
+                m_session_cfg,
+                std::move(io_ref),
+                std::move(wheel))
+                ->accept();
         }
-        handle_accept();
     }
 
   public:
@@ -134,6 +347,8 @@ class listener : public std::enable_shared_from_this<listener>
 
     /**
      * @param p_io_ctx The io context to use.
+     * @param p_session_ctxs The io contexts to pin the sessions to,
+     * if empty the sessions run on strands of 'p_io_ctx'.
      * @param p_ssl_ctx The ssl context to use.
      * @param p_endpoint The endpoint to open the listener.
      * @param p_manager The manager to track the sessions.
@@ -142,6 +357,7 @@ class listener : public std::enable_shared_from_this<listener>
      * @param p_session_cfg The config for each session.
      */
     listener(boost::asio::io_context &p_io_ctx,
+             const std::vector<boost::asio::io_context *> &p_session_ctxs,
 #ifdef RADRPC_SSL_SUPPORT
              ssl::context *p_ssl_ctx,
 #endif
@@ -154,52 +370,36 @@ class listener : public std::enable_shared_from_this<listener>
         m_ssl_ctx(p_ssl_ctx),
 #endif
         m_io_ctx(p_io_ctx),
-        m_acceptor(boost::asio::make_strand(p_io_ctx)),
         m_server_cfg(p_server_cfg),
         m_server_timeout(p_server_timeout),
         m_session_cfg(p_session_cfg),
         manager(p_manager->shared_from_this())
     {
+        for (auto io_ctx : p_session_ctxs)
+            m_slots.push_back(io_slot{io_ctx, std::make_shared<char>(0), {}});
 #ifdef RADRPC_SSL_SUPPORT
         if (m_ssl_ctx != nullptr)
             RADRPC_LOG("+listener: SSL enabled");
         else
 #endif
             RADRPC_LOG("+listener: SSL disabled");
-        boost::system::error_code ec;
 
         // Set current amount of references so they can be
         // subtracted to get the amount of connections
         manager->set_subtract_refs();
 
-        m_acceptor.open(p_endpoint.protocol(), ec);
-        if (ec)
-        {
-            RADRPC_LOG("+listener:: Acceptor open failed\n" << ec.message());
-            return;
-        }
-
-        m_acceptor.set_option(boost::asio::socket_base::reuse_address(true),
-                              ec);
-        if (ec)
-        {
-            RADRPC_LOG("+listener:: Acceptor set option failed\n"
-                       << ec.message());
-            return;
-        }
-
-        m_acceptor.bind(p_endpoint, ec);
-        if (ec)
-        {
-            RADRPC_LOG("+listener:: Acceptor bind failed\n" << ec.message());
-            return;
-        }
-
-        m_acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
-        if (ec)
+        // Each acceptor runs on its own strand or on the
+        // io context it pins the sessions to.
+        auto count = acceptor_count(p_server_cfg);
+        for (std::size_t i = 0; i < count; ++i)
         {
-            RADRPC_LOG("+listener:: Acceptor listen failed\n" << ec.message());
-            return;
+            if (m_slots.size() == count)
+                m_acceptors.push_back(std::make_shared<tcp::acceptor>(
+                    m_slots[i].io_ctx->get_executor()));
+            else
+                m_acceptors.push_back(std::make_shared<tcp::acceptor>(
+                    boost::asio::make_strand(p_io_ctx)));
+            open_acceptor(*m_acceptors.back(), p_endpoint, count > 1);
         }
     }
 
@@ -207,12 +407,18 @@ class listener : public std::enable_shared_from_this<listener>
 
     /**
      * Start the listener & accept new connections.
+     * This function can only be called once.
      */
     void run()
     {
-        if (!m_acceptor.is_open())
-            return;
-        handle_accept();
+        auto pending = std::max(m_server_cfg.pending_accepts, 1u);
+        for (std::size_t i = 0; i < m_acceptors.size(); ++i)
+        {
+            for (auto j = 0u; j < pending; ++j)
+                handle_accept(m_acceptors[i], i);
+        }
+        // Hand over the acceptors to the pending accepts.
+        m_acceptors.clear();
         RADRPC_LOG("listener::run");
     }
 };
@@ -26,6 +26,7 @@
 #define RADRPC_IMPL_SERVER_SERVER_SESSION_HPP
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <deque>
@@ -46,7 +47,15 @@
 
 #include <radrpc/debug.hpp>
 #include <radrpc/types.hpp>
+#include <radrpc/detail/buffer_pool.hpp>
 #include <radrpc/detail/data.hpp>
+#include <radrpc/detail/token_bucket.hpp>
+#include <radrpc/impl/server/admission.hpp>
+#include <radrpc/impl/server/bulkhead.hpp>
+#include <radrpc/impl/server/fair_scheduler.hpp>
+#include <radrpc/impl/server/ip_admission.hpp>
+#include <radrpc/impl/server/session_registry.hpp>
+#include <radrpc/impl/server/timer_wheel.hpp>
 
 namespace radrpc {
 
@@ -60,7 +69,7 @@ class session_context
                         ///< close
     detail::io_header
         m_header; ///< The io_header to send along with the bytes to the client.
-    boost::beast::flat_buffer
+    detail::pooled_flat_buffer
         m_receive_buffer; ///< The buffer to receive incoming client requests.
     boost::asio::const_buffer
         m_receive_buffer_ref; ///< The buffer's reference to the actual data.
@@ -68,6 +77,8 @@ class session_context
     handshake_request m_req_handshake; ///< The handshake from the client.
     handshake_response
         m_res_handshake; ///< The handshake to send to the client.
+    impl::server::session_registry
+        *m_registry; ///< The registry to subscribe the session in.
 
     ~session_context() = default;
 
@@ -75,6 +86,10 @@ class session_context
     uint64_t id;                   ///< The unique id of this session.
     const std::string remote_host; ///< The clients ip address.
     std::vector<char> response;    ///< The bytes to send for a response.
+    detail::pooled_vector
+        pooled_response; ///< The bytes to send if 'response' is empty,
+                         ///< drawn from the buffer pool of the server.
+    send_priority response_priority; ///< The priority to send the response.
 
     /**
      *
@@ -82,16 +97,25 @@ class session_context
      * @param p_remote_host The ip address of the client.
      * @param p_session_cfg The config for this session.
      * @param p_server_timeout The server timeout.
+     * @param p_buffers The pool to draw the receive buffer
+     * & the response from.
+     * @param p_registry The registry to subscribe the session in.
      */
     session_context(uint64_t p_id,
                     std::string p_remote_host,
                     const session_config &p_session_cfg,
-                    const server_timeout &p_server_timeout) :
+                    const server_timeout &p_server_timeout,
+                    std::shared_ptr<detail::buffer_pool> p_buffers,
+                    impl::server::session_registry *p_registry) :
         m_bound_close(false),
         m_header(0, 0),
+        m_receive_buffer(detail::pool_allocator<char>(p_buffers)),
         m_config(p_session_cfg),
+        m_registry(p_registry),
         id(p_id),
-        remote_host(std::move(p_remote_host))
+        remote_host(std::move(p_remote_host)),
+        pooled_response(detail::pool_allocator<char>(std::move(p_buffers))),
+        response_priority(send_priority::response)
     {
     }
 
@@ -120,6 +144,26 @@ class session_context
      */
     void close() { m_bound_close = true; }
 
+    /**
+     * Subscribes the session to a topic.
+     * @param topic The topic to subscribe to.
+     * @return True if subscribed, false if the session is closed.
+     */
+    bool subscribe(const std::string &topic)
+    {
+        return m_registry->subscribe(id, topic);
+    }
+
+    /**
+     * Unsubscribes the session from a topic.
+     * @param topic The topic to unsubscribe from.
+     * @return True if unsubscribed, false if it was not subscribed.
+     */
+    bool unsubscribe(const std::string &topic)
+    {
+        return m_registry->unsubscribe(id, topic);
+    }
+
     /**
      * Returns the used session config.
      * @return The session config.
@@ -162,13 +206,39 @@ enum class ping_state
 template <class Derived, class SharedRef>
 class server_session : private session_context
 {
+    typedef detail::mpsc_ring<std::shared_ptr<detail::data_push>,
+                              config::inbox_size>
+        inbox_ring;
+
     bool m_write_error; ///< Info for read error.
     bool m_read_error;  ///< Info for write error.
     std::shared_ptr<SharedRef>
         m_manager; ///< The manager shared among sessions.
-    std::deque<std::shared_ptr<detail::data_push>>
-        m_queue; ///< A queue to hold the data to send.
+    detail::push_queue m_queue; ///< A queue to hold the data to send.
+    std::shared_ptr<detail::data_push>
+        m_writing; ///< The data which is currently written.
+    time_point m_writing_queued; ///< The time 'm_writing' was queued.
+    bool m_slow; ///< Whether the session exceeded the pending limits.
+    bool m_read_paused; ///< Whether reading waits for the queue to drain.
+    time_point m_received; ///< The time the current request was received.
+    const std::string m_own_tenant; ///< The tenant if none was configured.
+    bool m_limiters_set; ///< Whether the rate limiters were configured.
+    detail::rate_limiter m_limiter; ///< The rate limiter of the requests.
+    std::unordered_map<uint32_t, detail::rate_limiter>
+        m_call_limiters; ///< The rate limiters of specific call ids.
+    std::atomic<inbox_ring *> m_inbox; ///< The data sent from other threads,
+                                       ///< allocated by the first send.
+    std::atomic<bool> m_inbox_posted; ///< Whether a drain is posted.
+    std::atomic<unsigned int>
+        m_inbox_overflows; ///< The posted data which didn't fit the inbox.
+    std::atomic<std::size_t>
+        m_inbox_bytes; ///< The bytes sent from other threads, not yet queued.
+    std::atomic<std::size_t>
+        m_queued_bytes; ///< The bytes of the queue & the current write.
     const server_timeout &m_server_timeout; ///< The used server timeout.
+    ip_admission::connection_ref
+        m_io_ref; ///< Counts the sessions of the used io context
+                  ///< & the connections of the address.
 
     friend class session_manager;
     template <typename T> friend class session_accept;
@@ -188,103 +258,370 @@ class server_session : private session_context
     }
 
     /**
-     * Calls the bound handler with the specified id & start a next read.
+     * Calls the bound handler with the specified id.
      * This function must be called within the executor context.
+     * @return True if the request was processed, false if it was deferred
+     * by the handler's bulkhead.
      */
-    void call_function()
+    bool call_function()
     {
         // Check io_header & call bound function
         m_receive_buffer_ref =
             boost::beast::buffers_front(m_receive_buffer.data());
-        if (m_receive_buffer_ref.size() >= sizeof(detail::io_header))
+        if (m_receive_buffer_ref.size() < sizeof(detail::io_header))
         {
-            m_header = *reinterpret_cast<const detail::io_header *>(
-                m_receive_buffer_ref.data());
-            uint32_t call_id = m_header.call_id;
-            auto func_itr = m_manager->bound_funcs.find(call_id);
-            m_receive_buffer.consume(sizeof(detail::io_header));
-            m_receive_buffer_ref =
-                boost::beast::buffers_front(m_receive_buffer.data());
-            if (func_itr != m_manager->bound_funcs.end())
+            RADRPC_LOG("server_session::call_function: Invalid buffer");
+            return true;
+        }
+        m_header = *reinterpret_cast<const detail::io_header *>(
+            m_receive_buffer_ref.data());
+        uint32_t call_id = m_header.call_id;
+        auto func_itr = m_manager->bound_funcs.find(call_id);
+        m_receive_buffer.consume(sizeof(detail::io_header));
+        m_receive_buffer_ref =
+            boost::beast::buffers_front(m_receive_buffer.data());
+        if (func_itr == m_manager->bound_funcs.end())
+        {
+            RADRPC_LOG("server_session::call_function: Call id "
+                       << call_id << " was not bound to any function");
+            return true;
+        }
+        auto &func = func_itr->second;
+        if (!func.handler)
+            return true;
+        if (m_manager->admission.enabled() &&
+            !m_manager->admission.admit(m_received))
+        {
+            RADRPC_LOG("server_session::call_function: Call id "
+                       << call_id << " shed, overloaded");
+            send_status(detail::io_status::overloaded);
+            return true;
+        }
+        uint64_t generation = 0;
+        if (func.limit)
+        {
+            // The resume handler owns the slot & keeps
+            // the session alive while it is queued.
+            auto result = func.limit->acquire(
+                [this, self{derived().shared_from_this()}, func_ptr{&func}](
+                    uint64_t slot_generation) {
+                    boost::asio::post(
+                        self->m_stream.get_executor(),
+                        [this, self, func_ptr, slot_generation] {
+                            resume_function(*func_ptr, slot_generation);
+                        });
+                },
+                generation);
+            if (result == bulkhead::result::queued)
             {
-                if (func_itr->second)
-                {
-                    // Call bound function
-                    func_itr->second(this);
-                    // Check if bound function requests to close
-                    if (m_bound_close)
-                    {
-                        RADRPC_LOG("server_session::call_function: Bound "
-                                   "function close request");
-                        derived().close_session();
-                        return;
-                    }
-                    // Check if bound function has added bytes to send back to
-                    // client
-                    if (!response.empty())
-                    {
-                        auto push = new detail::data_push(m_header);
-                        push->body.swap(response);
-                        handle_send(std::shared_ptr<detail::data_push>(push));
-                    }
-                }
+                RADRPC_LOG("server_session::call_function: Call id "
+                           << call_id << " queued");
+                return false;
             }
-            else
+            if (result == bulkhead::result::rejected)
             {
                 RADRPC_LOG("server_session::call_function: Call id "
-                           << call_id << " was not bound to any function");
+                           << call_id << " rejected");
+                send_status(detail::io_status::rejected);
+                return true;
             }
         }
-        else
+        execute_function(func, generation);
+        return true;
+    }
+
+    /**
+     * Executes the bound handler & queues its response.
+     * This function must be called within the executor context.
+     * @param func The bound handler to execute.
+     * @param generation The generation of the slot of its bulkhead.
+     */
+    void execute_function(bound_func &func, uint64_t generation)
+    {
+        // Call bound function
+        func.handler(this);
+        if (func.limit)
+            func.limit->release(generation);
+        // Check if bound function requests to close
+        if (m_bound_close)
         {
-            RADRPC_LOG("server_session::call_function: Invalid buffer");
+            RADRPC_LOG("server_session::call_function: Bound "
+                       "function close request");
+            derived().close_session();
+            return;
+        }
+        // Check if bound function has added bytes to send back to
+        // client
+        if (!response.empty() || !pooled_response.empty())
+        {
+            auto push = make_push(response_priority);
+            if (response.empty())
+                push->pooled_body = std::move(pooled_response);
+            else
+                push->body.swap(response);
+            if (!handle_send(push))
+                send_status(detail::io_status::rejected);
         }
     }
 
+    /**
+     * Executes a request which was deferred by the handler's bulkhead
+     * & continues reading.
+     * This function must be called within the executor context.
+     * @param func The bound handler which got a free slot.
+     * @param generation The generation of the slot.
+     */
+    void resume_function(bound_func &func, uint64_t generation)
+    {
+        if (!derived().m_close && !m_write_error)
+            execute_function(func, generation);
+        else
+            func.limit->release(generation);
+        next_read();
+    }
+
+    /**
+     * Sends an empty response with the given status to the client.
+     * This function must be called within the executor context.
+     * @param status The status to send.
+     */
+    void send_status(detail::io_status status)
+    {
+        // Nobody is waiting on requests without a result id
+        if (m_header.result_id == 0)
+            return;
+        auto push = make_push(send_priority::control);
+        push->header.status = static_cast<uint32_t>(status);
+        handle_send(push);
+    }
+
+    /**
+     * Creates the data to send for the current request, allocated
+     * with its reference count from the buffer pool of the server.
+     * @param priority The priority to queue the data with.
+     * @return The data to send.
+     */
+    std::shared_ptr<detail::data_push> make_push(send_priority priority)
+    {
+        return std::allocate_shared<detail::data_push>(
+            detail::pool_allocator<detail::data_push>(m_manager->buffers),
+            m_header,
+            priority);
+    }
+
     /**
      * Send data to the client.
+     * Conflated data replaces the unsent data with the same key,
+     * even if the budget is exhausted, unless it grows the queue
+     * beyond the budget.
      * This function must be called within the executor context.
      * @param data
+     * @return True if queued, false if dropped.
      */
-    void handle_send(const std::shared_ptr<detail::data_push> &data)
+    bool handle_send(const std::shared_ptr<detail::data_push> &data)
     {
         if (derived().m_close || derived().m_close_received || m_write_error ||
             m_read_error)
+            return false;
+        if (auto replaced = m_queue.conflated(*data))
+        {
+            if (m_config.max_queued_bytes != 0 &&
+                data->size() > replaced->size() &&
+                queued_bytes() - replaced->size() + data->size() >
+                    m_config.max_queued_bytes)
+            {
+                RADRPC_LOG("server_session::handle_send: Budget exceeded");
+                return false;
+            }
+            m_queue.replace(data);
+            sync_queued_bytes();
+            return true;
+        }
+        check_progress();
+        if (derived().m_close)
+            return false;
+        if (m_slow && m_config.slow_consumer == slow_consumer_action::drop &&
+            data->priority == send_priority::broadcast)
+            return false;
+        if (exceeds_budget(queued_bytes(), *data))
+        {
+            RADRPC_LOG("server_session::handle_send: Budget exceeded");
+            return false;
+        }
+        m_queue.push(data);
+        sync_queued_bytes();
+        if (!m_writing)
+            write();
+        return true;
+    }
+
+    /**
+     * Returns the bytes of the queue & the current write.
+     * This function must be called within the executor context.
+     * @return The queued bytes.
+     */
+    std::size_t queued_bytes() const
+    {
+        return m_queue.bytes() + (m_writing ? m_writing->size() : 0);
+    }
+
+    /**
+     * Publishes the queued bytes for the budget checks
+     * of other threads.
+     * This function must be called within the executor context.
+     */
+    void sync_queued_bytes()
+    {
+        m_queued_bytes.store(queued_bytes(), std::memory_order_relaxed);
+    }
+
+    /**
+     * Checks whether queueing the data exceeds the byte budget.
+     * Control messages & conflated data, which replaces queued data,
+     * are not limited.
+     * @param pending The bytes which are already pending.
+     * @param data The data to queue.
+     * @return True if exceeded, false if not.
+     */
+    bool exceeds_budget(std::size_t pending,
+                        const detail::data_push &data) const
+    {
+        return m_config.max_queued_bytes != 0 &&
+               data.priority != send_priority::control && !data.conflate &&
+               pending + data.size() > m_config.max_queued_bytes;
+    }
+
+    /**
+     * Returns the write progress of the session.
+     * This function must be called within the executor context.
+     * @return The write progress.
+     */
+    write_progress progress() const
+    {
+        write_progress result{
+            queued_bytes(), m_queue.size(), duration::zero()};
+        auto oldest = m_queue.oldest();
+        if (m_writing)
+        {
+            result.pending_messages++;
+            oldest = (std::min)(oldest, m_writing_queued);
+        }
+        if (result.pending_messages != 0)
+            result.oldest_age = std::chrono::steady_clock::now() - oldest;
+        return result;
+    }
+
+    /**
+     * Checks whether the write progress exceeds the pending limits.
+     * @param current The write progress to check.
+     * @return True if exceeded, false if not.
+     */
+    bool exceeds_limits(const write_progress &current) const
+    {
+        return (m_config.max_pending_bytes != 0 &&
+                current.pending_bytes > m_config.max_pending_bytes) ||
+               (m_config.max_pending_age != duration::zero() &&
+                current.oldest_age > m_config.max_pending_age);
+    }
+
+    /**
+     * Takes the configured action once the session starts
+     * to exceed the pending limits. The session stays slow
+     * until a write completes within the limits.
+     * This function must be called within the executor context.
+     */
+    void check_progress()
+    {
+        if (m_slow || (m_config.max_pending_bytes == 0 &&
+                       m_config.max_pending_age == duration::zero()))
             return;
-        if (m_queue.size() >= config::queue_send_max)
-            return;
-        m_queue.push_back(data);
-        if (m_queue.size() > 1)
+        auto current = progress();
+        if (!exceeds_limits(current))
             return;
-        write();
+        m_slow = true;
+        RADRPC_LOG("server_session::check_progress: Slow session, "
+                   << current.pending_bytes << " bytes pending");
+        if (m_manager->on_slow_consumer)
+            m_manager->on_slow_consumer(std::cref(info), current);
+        if (m_config.slow_consumer == slow_consumer_action::drop)
+        {
+            m_queue.clear(send_priority::broadcast);
+            sync_queued_bytes();
+        }
+        else if (m_config.slow_consumer == slow_consumer_action::close)
+            derived().abort_session();
     }
 
     /**
-     * Write the message queued by 'handle_send()'.
+     * Returns the inbox & allocates it on the first call, so sessions
+     * which only answer requests don't keep the slots of an inbox.
+     * [thread-safe]
+     * @return The inbox, nullptr if compact.
+     */
+    inbox_ring *inbox_of()
+    {
+        auto inbox = m_inbox.load(std::memory_order_acquire);
+        if (inbox || m_manager->server_cfg.compact)
+            return inbox;
+        std::unique_ptr<inbox_ring> created(new inbox_ring());
+        if (!m_inbox.compare_exchange_strong(
+                inbox, created.get(), std::memory_order_acq_rel))
+            return inbox;
+        return created.release();
+    }
+
+    /**
+     * Moves the data of the inbox to the queue & writes it.
+     * This function must be called within the executor context.
+     */
+    void drain_inbox()
+    {
+        // Reset before popping, so data pushed after
+        // the last pop will post the next drain.
+        m_inbox_posted.exchange(false, std::memory_order_acq_rel);
+        auto inbox = m_inbox.load(std::memory_order_acquire);
+        std::shared_ptr<detail::data_push> data;
+        while (inbox && inbox->pop(data))
+        {
+            m_inbox_bytes -= data->size();
+            handle_send(data);
+        }
+    }
+
+    /**
+     * Handles data which didn't fit the inbox,
+     * after the data which was pushed before.
+     * This function must be called within the executor context.
+     * @param data The data to send.
+     */
+    void drain_overflow(const std::shared_ptr<detail::data_push> &data)
+    {
+        drain_inbox();
+        m_inbox_bytes -= data->size();
+        handle_send(data);
+        --m_inbox_overflows;
+    }
+
+    /**
+     * Write the message with the highest priority queued by 'handle_send()'.
+     * Messages are only picked once the previous write has completed,
+     * so a queued response overtakes already queued broadcasts.
      * This function must be called within the executor context.
      */
     void write()
     {
+        // The data in progress is held by 'm_writing' until 'on_write()',
+        // so clearing the queue can't free it while async_write is processing.
+        m_writing = m_queue.pop(m_writing_queued);
         derived().m_stream.async_write(
-            std::vector<boost::asio::const_buffer>{
+            std::array<boost::asio::const_buffer, 2>{{
                 boost::asio::buffer(
-                    reinterpret_cast<char *>(&m_queue.front()->header),
+                    reinterpret_cast<char *>(&m_writing->header),
                     sizeof(detail::io_header)),
-                boost::asio::buffer(m_queue.front()->body),
-            },
+                m_writing->body_buffer(),
+            }},
             boost::beast::bind_front_handler(&server_session::on_write,
                                              derived().shared_from_this()));
-        // IF we are going to operate on the queue for example with 'clear()',
-        // it is needed to also pass the reference of the data to the handler,
-        // because it is only referenced in the queue.
-        // Clearing it while async_write is processing means a 'heap use after
-        // free' error. The alternative handler binding could look like this:
-        // boost::beast::bind_front_handler(&server_session::on_write,
-        //                                  derived().shared_from_this(),
-        //                                  m_queue.front()->shared_from_this())
-        // The handler needs also to be changed.
-        // But since removing entries happens only in 'on_write()' it is fine
-        // now.
     }
 
     /**
@@ -298,12 +635,25 @@ class server_session : private session_context
             RADRPC_LOG("server_session::on_write: " << ec.message());
             m_write_error = true;
             m_queue.clear();
+            m_writing.reset();
+            sync_queued_bytes();
             derived().close_session();
             return;
         }
-        m_queue.erase(m_queue.begin());
+        m_writing.reset();
+        sync_queued_bytes();
+        if (m_slow)
+            m_slow = exceeds_limits(progress());
+        if (m_read_paused && queued_bytes() <= m_config.read_resume_bytes)
+        {
+            RADRPC_LOG("server_session::on_write: Resume reading");
+            m_read_paused = false;
+            read();
+        }
         if (!m_queue.empty())
             write();
+        else if (m_manager->server_cfg.compact)
+            m_queue.shrink();
     }
 
     /**
@@ -320,10 +670,171 @@ class server_session : private session_context
             return;
         }
         RADRPC_LOG("server_session::on_read: " << bytes_transferred << "bytes");
-        if (!derived().m_close && !m_write_error)
-            call_function();
+        if (!derived().m_close && !m_write_error && !limit_rate())
+            return;
+        receive();
+    }
+
+    /**
+     * Applies the rate limit of the call id to the received request.
+     * The limiters are set up with the first request, since the
+     * config may be changed by the accept handler.
+     * This function must be called within the executor context.
+     * @return True if the request is in the limit, false if it was
+     * delayed, rejected or the session is closed.
+     */
+    bool limit_rate()
+    {
+        auto buffer_ref = boost::beast::buffers_front(m_receive_buffer.data());
+        if (buffer_ref.size() < sizeof(detail::io_header))
+            return true;
+        if (!m_limiters_set)
+        {
+            m_limiters_set = true;
+            m_limiter = detail::rate_limiter(m_config.limit);
+            for (const auto &limit : m_config.call_limits)
+                m_call_limiters.emplace(limit.first,
+                                        detail::rate_limiter(limit.second));
+        }
+        auto header =
+            reinterpret_cast<const detail::io_header *>(buffer_ref.data());
+        auto limiter_itr = m_call_limiters.find(header->call_id);
+        auto &limiter = limiter_itr == m_call_limiters.end()
+                            ? m_limiter
+                            : limiter_itr->second;
+        if (!limiter.enabled())
+            return true;
+        auto now = std::chrono::steady_clock::now();
+        auto wait = limiter.wait_time(buffer_ref.size(), now);
+        if (wait == duration::zero())
+        {
+            limiter.consume(buffer_ref.size());
+            return true;
+        }
+        m_manager->count_rate_limited(m_config.rate_limited);
+        switch (m_config.rate_limited)
+        {
+            case rate_limit_action::delay:
+                RADRPC_LOG("server_session::limit_rate: Delay call id "
+                           << header->call_id);
+                // Consumed now, so the following requests wait for it
+                limiter.consume(buffer_ref.size());
+                derived().delay_receive(wait);
+                break;
+            case rate_limit_action::reject:
+                RADRPC_LOG("server_session::limit_rate: Reject call id "
+                           << header->call_id);
+                m_header = *header;
+                send_status(detail::io_status::rejected);
+                next_read();
+                break;
+            default:
+                RADRPC_LOG("server_session::limit_rate: Close");
+                derived().close_session();
+                break;
+        }
+        return false;
+    }
+
+    /**
+     * Dispatches the received request within the limits.
+     * This function must be called within the executor context.
+     */
+    void receive()
+    {
+        if (m_manager->admission.enabled())
+        {
+            // Dispatch through the queue of the executor,
+            // so the sojourn time includes waiting in it.
+            m_received = std::chrono::steady_clock::now();
+            boost::asio::post(
+                derived().m_stream.get_executor(),
+                boost::beast::bind_front_handler(&server_session::dispatch,
+                                                 derived().shared_from_this()));
+            return;
+        }
+        dispatch();
+    }
+
+    /**
+     * Calls the bound handler of the received request & continues
+     * reading, unless the request was deferred.
+     * This function must be called within the executor context.
+     */
+    void dispatch()
+    {
+        auto &scheduler = m_manager->scheduler;
+        if (scheduler.enabled() && !derived().m_close && !m_write_error)
+        {
+            // The resume handler owns the slot & keeps
+            // the session alive while it is queued.
+            uint64_t generation = 0;
+            auto result = scheduler.acquire(
+                m_config.tenant.empty() ? m_own_tenant : m_config.tenant,
+                m_config.weight,
+                [this, self{derived().shared_from_this()}](
+                    uint64_t slot_generation) {
+                    boost::asio::post(
+                        self->m_stream.get_executor(),
+                        [this, self, slot_generation] {
+                            dispatch_scheduled(slot_generation);
+                        });
+                },
+                generation);
+            if (result == fair_scheduler::result::queued)
+                return;
+            dispatch_scheduled(generation);
+            return;
+        }
+        if (!derived().m_close && !m_write_error && !call_function())
+            return;
+        next_read();
+    }
+
+    /**
+     * Calls the bound handler with a slot of the fair scheduler,
+     * releases the slot & continues reading.
+     * This function must be called within the executor context.
+     * @param generation The generation of the slot.
+     */
+    void dispatch_scheduled(uint64_t generation)
+    {
+        bool processed =
+            derived().m_close || m_write_error || call_function();
+        m_manager->scheduler.release(generation);
+        if (processed)
+            next_read();
+    }
+
+    /**
+     * Releases the processed request & starts the next read.
+     * If the queued bytes crossed the pause watermark, the read is
+     * started by 'on_write()' once they drained to the resume
+     * watermark, so the client is slowed down by tcp instead.
+     * This function must be called within the executor context.
+     */
+    void next_read()
+    {
         m_receive_buffer.consume(m_receive_buffer.size());
+        // Hibernate a buffer grown by a large request, the next read
+        // takes a frame from the pool again, so small ones are kept.
+        auto keep = m_config.hibernate_bytes;
+        if (m_manager->server_cfg.compact &&
+            (keep == 0 || keep > config::compact_buffer_bytes))
+            keep = config::compact_buffer_bytes;
+        if (keep != 0 && m_receive_buffer.capacity() > keep)
+            m_receive_buffer.shrink_to_fit();
         response = std::vector<char>();
+        pooled_response.clear();
+        pooled_response.shrink_to_fit();
+        response_priority = send_priority::response;
+        if (m_config.read_pause_bytes != 0 && m_writing &&
+            queued_bytes() > m_config.read_pause_bytes)
+        {
+            RADRPC_LOG("server_session::next_read: Pause reading");
+            m_read_paused = true;
+            return;
+        }
         // Read operations allowed, since 
         // it would read until an error occures.
         read();
@@ -337,20 +848,37 @@ class server_session : private session_context
      * @param p_manager The manager shared among sessions.
      * @param p_server_timeout The server timeout.
      * @param p_session_cfg The config to use for this session.
+     * @param p_io_ref The reference counting the sessions of the io context
+     * & the connections of the address.
      */
     explicit server_session(std::string p_remote_host,
                             const std::shared_ptr<SharedRef> &p_manager,
                             const server_timeout &p_server_timeout,
-                            const session_config &p_session_cfg) :
+                            const session_config &p_session_cfg,
+                            ip_admission::connection_ref p_io_ref) :
         radrpc::session_context(
             reinterpret_cast<uint64_t>(&(derived().m_stream)),
             std::move(p_remote_host),
             p_session_cfg,
-            p_server_timeout),
+            p_server_timeout,
+            p_manager->buffers,
+            &p_manager->sessions()),
         m_write_error(false),
         m_read_error(false),
         m_manager(p_manager->shared_from_this()),
+        m_slow(false),
+        m_read_paused(false),
+        m_own_tenant(p_manager->server_cfg.fair_concurrency == 0
+                         ? std::string()
+                         : std::string(1, '\0') + std::to_string(id)),
+        m_limiters_set(false),
+        m_inbox(nullptr),
+        m_inbox_posted(false),
+        m_inbox_overflows(0),
+        m_inbox_bytes(0),
+        m_queued_bytes(0),
         m_server_timeout(p_server_timeout),
+        m_io_ref(std::move(p_io_ref)),
         info(session_info{id,
                           remote_host,
                           m_req_handshake,
@@ -363,20 +891,45 @@ class server_session : private session_context
     ~server_session()
     {
         RADRPC_LOG("~server_session");
+        delete m_inbox.load(std::memory_order_relaxed);
         if (m_manager->on_disconnect)
             m_manager->on_disconnect(std::ref(info));
     }
 
     /**
-     * @param data
+     * Pushes the data to the inbox & posts a drain if there
+     * was none posted. If the inbox is full, the data is posted
+     * on its own, followed by the next data of this caller.
+     * [thread-safe]
+     * @param data The data to send.
+     * @return True if accepted, false if the byte budget is exceeded.
      */
-    void send(std::shared_ptr<detail::data_push> data)
+    bool send(std::shared_ptr<detail::data_push> data)
     {
+        // Concurrent senders may overshoot the budget by their data
+        auto pending = m_queued_bytes.load(std::memory_order_relaxed) +
+                       m_inbox_bytes.load(std::memory_order_relaxed);
+        if (exceeds_budget(pending, *data))
+            return false;
+        m_inbox_bytes += data->size();
+        auto inbox = inbox_of();
+        if (inbox && m_inbox_overflows == 0 && inbox->push(data))
+        {
+            if (m_inbox_posted.exchange(true, std::memory_order_acq_rel))
+                return true;
+            boost::asio::post(
+                derived().m_stream.get_executor(),
+                boost::beast::bind_front_handler(&server_session::drain_inbox,
+                                                 derived().shared_from_this()));
+            return true;
+        }
+        ++m_inbox_overflows;
         boost::asio::post(
             derived().m_stream.get_executor(),
-            boost::beast::bind_front_handler(&server_session::handle_send,
+            boost::beast::bind_front_handler(&server_session::drain_overflow,
                                              derived().shared_from_this(),
-                                             data));
+                                             std::move(data)));
+        return true;
     }
 };
 
@@ -385,121 +938,198 @@ class server_session : private session_context
  */
 class session_manager : public std::enable_shared_from_this<session_manager>
 {
-    typedef std::unordered_map<uint64_t,
-                               std::weak_ptr<server_session<
-                                   session_accept<server_streams::plain_stream>,
-                                   session_manager>>>
-        plain_sessions;
-#ifdef RADRPC_SSL_SUPPORT
-    typedef std::unordered_map<
-        uint64_t,
-        std::weak_ptr<server_session<session_accept<server_streams::ssl_stream>,
-                                     session_manager>>>
-        ssl_sessions;
-#endif
     long m_sub_refs; ///< The reference count before any session is created.
-    std::atomic<long> m_msg_queued;  ///< The amount of the queued messages.
-    std::mutex m_plain_mtx;          ///< Lock for operating on 'plain_sessions'
-    plain_sessions m_plain_sessions; ///< Holds all plain sessions.
-#ifdef RADRPC_SSL_SUPPORT
-    std::mutex m_ssl_mtx;        ////< Lock for operating on 'ssl_sessions'
-    ssl_sessions m_ssl_sessions; ///< Holds all ssl sessions.
-#endif
+    const std::shared_ptr<std::atomic<std::size_t>>
+        m_bytes_queued; ///< The bytes of the messages to send, owned
+                        ///< separately to keep the reference count a
+                        ///< session count while messages are queued.
+    std::atomic<uint64_t> m_rate_delayed;  ///< The delayed requests.
+    std::atomic<uint64_t> m_rate_rejected; ///< The rejected requests.
+    std::atomic<uint64_t> m_rate_closed;   ///< The sessions closed.
+    const std::shared_ptr<session_registry>
+        m_sessions; ///< Holds all plain & ssl sessions, owned separately
+                    ///< to keep the reference count a session count.
+    std::vector<boost::asio::strand<boost::asio::io_context::executor_type>>
+        m_fanout_strands; ///< Fans out the broadcasts, one per shard.
+
+    /**
+     * Copies the bytes into a shared body.
+     * @param bytes The bytes to copy.
+     * @return The shared body.
+     */
+    static std::shared_ptr<const std::vector<char>>
+    share_body(const std::vector<char> &bytes)
+    {
+        return std::make_shared<const std::vector<char>>(bytes);
+    }
+
+    /**
+     * Moves the bytes into a shared body.
+     * @param bytes The bytes to move.
+     * @return The shared body.
+     */
+    static std::shared_ptr<const std::vector<char>>
+    share_body(std::vector<char> &&bytes)
+    {
+        return std::make_shared<const std::vector<char>>(std::move(bytes));
+    }
+
+    /**
+     * @param bytes The already shared body.
+     * @return The shared body.
+     */
+    static std::shared_ptr<const std::vector<char>>
+    share_body(std::shared_ptr<const std::vector<char>> bytes)
+    {
+        return bytes;
+    }
+
+    /**
+     * @param bytes The bytes to send.
+     * @return The size of the bytes.
+     */
+    static std::size_t body_size(const std::vector<char> &bytes)
+    {
+        return bytes.size();
+    }
+
+    /**
+     * @param bytes The shared bytes to send.
+     * @return The size of the bytes.
+     */
+    static std::size_t
+    body_size(const std::shared_ptr<const std::vector<char>> &bytes)
+    {
+        return bytes->size();
+    }
 
     /**
      * Broadcasts data to specific sessions.
+     * The body is shared by all sessions & only converted by
+     * 'share_body()' if the message is actually sent.
      * @tparam StlContainer The container type to use, usually a vector or set.
+     * @tparam Body The bytes, either a vector or a shared vector.
      * @param call_id The id to call on the clients.
      * @param send_bytes The bytes to send to the clients
      * @param session_ids The session ids to broadcast this message.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     */
+    template <typename StlContainer, typename Body>
+    bool broadcast(uint32_t call_id,
+                   Body &&send_bytes,
+                   StlContainer *session_ids,
+                   send_priority priority)
+    {
+        if (connections() == 0)
+            return true;
+        auto push_ptr =
+            make_push(call_id, std::forward<Body>(send_bytes), priority);
+        if (!push_ptr)
+            return false;
+        return fan_out(push_ptr, session_ids);
+    }
+
+    /**
+     * Sends the message to specific sessions.
+     * The sessions reached by the fan out on the workers
+     * are not included in the result.
+     * @tparam StlContainer The container type to use, usually a vector or set.
+     * @param push_ptr The message to send.
+     * @param session_ids The session ids, nullptr to send to all sessions.
+     * @return True if all reached sessions accepted the message,
+     * false if not.
      */
     template <typename StlContainer>
-    void broadcast(uint32_t call_id,
-                   const std::vector<char> &send_bytes,
-                   StlContainer *session_ids)
+    bool fan_out(const std::shared_ptr<detail::data_push> &push_ptr,
+                 StlContainer *session_ids)
     {
-        if (m_msg_queued >= config::queue_send_max)
+        bool accepted = true;
+        auto send = [&](const session_registry::entry &session) {
+            if (!session.send(push_ptr))
+                accepted = false;
+        };
+        if (session_ids)
         {
-            RADRPC_LOG("session_manager::broadcast: Queue is full");
-            return;
+            m_sessions->for_each(*session_ids, send);
+            return accepted;
         }
-        if (connections() == 0)
-            return;
-        auto push = new detail::data_push(detail::io_header(call_id, 0));
-        push->body = send_bytes;
-        auto push_ptr = std::shared_ptr<detail::data_push>(
-            push,
-            std::bind(&session_manager::on_msg_sent,
-                      shared_from_this(),
-                      std::placeholders::_1));
-        m_msg_queued++;
-
-        // Copy sessions to avoid long locking.
-        plain_sessions plain_sessions_tmp;
+        if (m_fanout_strands.empty())
         {
-            std::unique_lock<std::mutex> lock(m_plain_mtx);
-            if (session_ids)
-            {
-                for (const auto &id : *session_ids)
-                {
-                    auto session_itr = m_plain_sessions.find(id);
-                    if (session_itr != m_plain_sessions.end())
-                        plain_sessions_tmp.emplace(session_itr->first,
-                                                   session_itr->second);
-                }
-            }
-            else
-            {
-                plain_sessions_tmp = m_plain_sessions;
-            }
+            m_sessions->for_each(send);
+            return accepted;
         }
-        for (auto const &s : plain_sessions_tmp)
-            if (auto session = s.second.lock())
-                session->send(push_ptr);
-
-
+        // One post per shard, the strand of a shard
+        // keeps the order of the broadcasts.
+        for (std::size_t i = 0; i < m_fanout_strands.size(); ++i)
+        {
+            if (m_sessions->shard_size(i) == 0)
+                continue;
+            boost::asio::post(
+                m_fanout_strands[i],
+                [sessions{m_sessions}, push_ptr, i] {
+                    sessions->for_each_in_shard(
+                        i, [&push_ptr](const session_registry::entry &session) {
+                            session.send(push_ptr);
+                        });
+                });
+        }
+        return true;
+    }
 
-#ifdef RADRPC_SSL_SUPPORT
-        // Copy sessions to avoid long locking.
-        ssl_sessions ssl_sessions_tmp;
+    /**
+     * Creates the message to send to several sessions,
+     * which is counted until it was sent to all of them.
+     * @tparam Body The bytes, either a vector or a shared vector.
+     * @param call_id The id to call on the clients.
+     * @param send_bytes The bytes to send to the clients
+     * @param priority The priority to queue the message with.
+     * @return The message, nullptr if the byte budget is exceeded.
+     */
+    template <typename Body>
+    std::shared_ptr<detail::data_push>
+    make_push(uint32_t call_id, Body &&send_bytes, send_priority priority)
+    {
+        // The body is shared, so it is only counted once
+        auto size = sizeof(detail::io_header) + body_size(send_bytes);
+        // Reserve the bytes, so concurrent callers can't exceed the budget
+        auto queued = m_bytes_queued->load();
+        do
         {
-            std::unique_lock<std::mutex> lock(m_ssl_mtx);
-            if (session_ids)
-            {
-                for (const auto &id : *session_ids)
-                {
-                    auto session_itr = m_ssl_sessions.find(id);
-                    if (session_itr != m_ssl_sessions.end())
-                        ssl_sessions_tmp.emplace(session_itr->first,
-                                                 session_itr->second);
-                }
-            }
-            else
+            if (server_cfg.max_queued_bytes != 0 &&
+                queued + size > server_cfg.max_queued_bytes)
             {
-                ssl_sessions_tmp = m_ssl_sessions;
+                RADRPC_LOG("session_manager::make_push: Budget exceeded");
+                return nullptr;
             }
-        }
-        for (auto const &s : ssl_sessions_tmp)
-            if (auto session = s.second.lock())
-                session->send(push_ptr);
-#endif
+        } while (!m_bytes_queued->compare_exchange_weak(queued, queued + size));
+        auto push =
+            new detail::data_push(detail::io_header(call_id, 0), priority);
+        push->shared_body = share_body(std::forward<Body>(send_bytes));
+        return std::shared_ptr<detail::data_push>(
+            push,
+            std::bind(&session_manager::on_msg_sent,
+                      m_bytes_queued,
+                      std::placeholders::_1));
     }
 
     /**
      * Used for decrementing the message counter.
+     * @param bytes_queued The counter of the queued bytes.
      * @param p
      */
-    void on_msg_sent(detail::data_push *p)
+    static void
+    on_msg_sent(const std::shared_ptr<std::atomic<std::size_t>> &bytes_queued,
+                detail::data_push *p)
     {
-        m_msg_queued--;
-        RADRPC_LOG("session_manager::on_msg_sent: " << m_msg_queued);
+        *bytes_queued -= p->size();
+        RADRPC_LOG("session_manager::on_msg_sent: " << *bytes_queued);
         delete p;
     }
 
   public:
     const server_config server_cfg; ///< The server config to use.
-    std::unordered_map<uint32_t,
-                       std::function<void(session_context *)>>
+    std::unordered_map<uint32_t, bound_func>
         bound_funcs; ///< The bound handlers.
     std::function<bool(session_info &)>
         on_accept; ///< The bound accept handler.
@@ -507,17 +1137,35 @@ class session_manager : public std::enable_shared_from_this<session_manager>
         on_listen; ///< The bound listen handler.
     std::function<void(const session_info &)>
         on_disconnect; ///< The bound disconnect handler.
+    std::function<void(const session_info &, const write_progress &)>
+        on_slow_consumer; ///< The bound slow consumer handler.
+    admission_control admission; ///< Sheds requests on overload.
+    fair_scheduler scheduler; ///< Schedules the executions among tenants.
+    const std::shared_ptr<ip_admission>
+        ip_filter; ///< Admits the connections by their address.
+    const std::shared_ptr<detail::buffer_pool>
+        buffers; ///< Keeps the released receive buffers for reuse.
 
     /**
      * @param p_server_cfg The server config to use.
      */
     explicit session_manager(server_config p_server_cfg) :
         m_sub_refs(0),
-        m_msg_queued(0),
+        m_bytes_queued(std::make_shared<std::atomic<std::size_t>>(0)),
+        m_rate_delayed(0),
+        m_rate_rejected(0),
+        m_rate_closed(0),
+        m_sessions(std::make_shared<session_registry>()),
         server_cfg(std::move(p_server_cfg)),
         on_accept(nullptr),
         on_listen(nullptr),
-        on_disconnect(nullptr)
+        on_disconnect(nullptr),
+        on_slow_consumer(nullptr),
+        admission(server_cfg.admission_target, server_cfg.admission_interval),
+        scheduler(server_cfg.fair_concurrency),
+        ip_filter(std::make_shared<ip_admission>(server_cfg.ip_filter)),
+        buffers(std::make_shared<detail::buffer_pool>(
+            server_cfg.buffer_pool_bytes))
     {
     }
 
@@ -553,98 +1201,212 @@ class session_manager : public std::enable_shared_from_this<session_manager>
     }
 
     /**
-     * Adds a plain session to the list.
-     * @param session The plain session to add.
+     * Returns the registry of the sessions.
+     * @return The registry.
      */
-    void
-    add_session(const std::shared_ptr<
-                server_session<session_accept<server_streams::plain_stream>,
-                               session_manager>> &session)
+    session_registry &sessions() { return *m_sessions; }
+
+    /**
+     * Adds a session to the registry.
+     * @tparam Session The type of the session.
+     * @param session The session to add.
+     */
+    template <typename Session>
+    void add_session(const std::shared_ptr<Session> &session)
     {
-        std::unique_lock<std::mutex> lock(m_plain_mtx);
-        m_plain_sessions[session->id] = std::weak_ptr<
-            server_session<session_accept<server_streams::plain_stream>,
-                           session_manager>>(session);
+        m_sessions->add(session->id, session);
     }
 
     /**
-     * Removes a plain session from the list.
-     * @tparam StreamType
+     * Removes a session from the registry.
      * @param id The id of the session to remove.
      */
-    template <typename StreamType>
-    typename std::enable_if<
-        std::is_same<StreamType, server_streams::plain_stream>::value,
-        void>::type
-    remove_session(uint64_t id)
+    void remove_session(uint64_t id) { m_sessions->remove(id); }
+
+    /**
+     * Counts a request exceeding the rate limit of its session.
+     * @param action The action taken.
+     */
+    void count_rate_limited(rate_limit_action action)
     {
-        std::unique_lock<std::mutex> lock(m_plain_mtx);
-        auto session_itr = m_plain_sessions.find(id);
-        if (session_itr != m_plain_sessions.end())
+        switch (action)
         {
-            m_plain_sessions.erase(session_itr);
+            case rate_limit_action::delay:
+                ++m_rate_delayed;
+                break;
+            case rate_limit_action::reject:
+                ++m_rate_rejected;
+                break;
+            default:
+                ++m_rate_closed;
+                break;
         }
     }
 
-#ifdef RADRPC_SSL_SUPPORT
-
     /**
-     * Adds a ssl session to the list.
-     * @param session The ssl session to add.
+     * Returns the requests which exceeded the rate limits.
+     * @return The statistics of the rate limits.
      */
-    void add_session(const std::shared_ptr<
-                     server_session<session_accept<server_streams::ssl_stream>,
-                                    session_manager>> &session)
+    rate_limit_stats get_rate_limit_stats() const
     {
-        std::unique_lock<std::mutex> lock(m_ssl_mtx);
-        m_ssl_sessions[session->id] = std::weak_ptr<
-            server_session<session_accept<server_streams::ssl_stream>,
-                           session_manager>>(session);
+        return rate_limit_stats{m_rate_delayed, m_rate_rejected, m_rate_closed};
     }
 
     /**
-     * Removes a ssl session from the list.
-     * @tparam StreamType
-     * @param id The id of the session to remove.
+     * Broadcasts data to all sessions.
+     * @tparam Body The bytes, either a vector or a shared vector.
+     * @param call_id The id to call on the clients.
+     * @param send_bytes The bytes to send to the clients
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
      */
-    template <typename StreamType>
-    typename std::enable_if<
-        std::is_same<StreamType, server_streams::ssl_stream>::value,
-        void>::type
-    remove_session(uint64_t id)
+    template <typename Body>
+    bool broadcast(uint32_t call_id, Body &&send_bytes, send_priority priority)
     {
-        std::unique_lock<std::mutex> lock(m_ssl_mtx);
-        auto session_itr = m_ssl_sessions.find(id);
-        if (session_itr != m_ssl_sessions.end())
-        {
-            m_ssl_sessions.erase(session_itr);
-        }
+        return broadcast(call_id,
+                  std::forward<Body>(send_bytes),
+                  (std::vector<uint64_t> *)nullptr,
+                  priority);
     }
 
-#endif
+    /**
+     * Broadcasts data to specific sessions.
+     * @tparam Body The bytes, either a vector or a shared vector.
+     * @param call_id The id to call on the clients.
+     * @param send_bytes The bytes to send to the clients
+     * @param session_ids The session ids to broadcast this message.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     */
+    template <typename StlContainer, typename Body>
+    bool broadcast(uint32_t call_id,
+                   Body &&send_bytes,
+                   const StlContainer &session_ids,
+                   send_priority priority)
+    {
+        return broadcast(
+            call_id, std::forward<Body>(send_bytes), &session_ids, priority);
+    }
 
     /**
-     * Broadcasts data to all sessions.
+     * Broadcasts data to all sessions, which replaces
+     * their unsent data with the same conflation key.
+     * @tparam Body The bytes, either a vector or a shared vector.
      * @param call_id The id to call on the clients.
+     * @param conflation_key The key of the data to replace.
      * @param send_bytes The bytes to send to the clients
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
      */
-    void broadcast(uint32_t call_id, const std::vector<char> &send_bytes)
+    template <typename Body>
+    bool broadcast_conflated(uint32_t call_id,
+                             uint64_t conflation_key,
+                             Body &&send_bytes,
+                             send_priority priority)
     {
-        broadcast(call_id, send_bytes, (std::vector<char> *)nullptr);
+        if (connections() == 0)
+            return true;
+        auto push_ptr =
+            make_push(call_id, std::forward<Body>(send_bytes), priority);
+        if (!push_ptr)
+            return false;
+        push_ptr->conflate = true;
+        push_ptr->conflation_key = conflation_key;
+        return fan_out(push_ptr, (std::vector<uint64_t> *)nullptr);
     }
 
     /**
-     * Broadcasts data to specific sessions.
+     * Publishes data to the subscribers of a topic.
+     * The subscribers are loaded from the topic index without locking,
+     * so the costs only depend on the amount of subscribers.
+     * @tparam Body The bytes, either a vector or a shared vector.
+     * @param topic The topic to publish to.
      * @param call_id The id to call on the clients.
      * @param send_bytes The bytes to send to the clients
-     * @param session_ids The session ids to broadcast this message.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
      */
-    template <typename StlContainer>
-    void broadcast(uint32_t call_id,
-                   const std::vector<char> &send_bytes,
-                   const StlContainer &session_ids)
+    template <typename Body>
+    bool publish(const std::string &topic,
+                 uint32_t call_id,
+                 Body &&send_bytes,
+                 send_priority priority)
     {
-        broadcast(call_id, send_bytes, &session_ids);
+        auto subscribers = m_sessions->subscribers_of(topic);
+        if (!subscribers)
+            return true;
+        auto push_ptr =
+            make_push(call_id, std::forward<Body>(send_bytes), priority);
+        if (!push_ptr)
+            return false;
+        bool accepted = true;
+        for (const auto &session : *subscribers)
+        {
+            if (!session.send(push_ptr))
+                accepted = false;
+        }
+        return accepted;
+    }
+
+    /**
+     * Subscribes a session to a topic.
+     * @param id The id of the session.
+     * @param topic The topic to subscribe to.
+     * @return True if subscribed, false if the session was not found.
+     */
+    bool subscribe(uint64_t id, const std::string &topic)
+    {
+        return m_sessions->subscribe(id, topic);
+    }
+
+    /**
+     * Unsubscribes a session from a topic.
+     * @param id The id of the session.
+     * @param topic The topic to unsubscribe from.
+     * @return True if unsubscribed, false if it was not subscribed.
+     */
+    bool unsubscribe(uint64_t id, const std::string &topic)
+    {
+        return m_sessions->unsubscribe(id, topic);
+    }
+
+    /**
+     * Returns the amount of subscribers of a topic.
+     * @param topic The topic to look up.
+     * @return The amount of subscribers.
+     */
+    std::size_t subscribers(const std::string &topic)
+    {
+        return m_sessions->subscribers(topic);
+    }
+
+    /**
+     * Sets the io contexts to fan out the broadcasts on.
+     * Each shard of the sessions gets a strand on one of them.
+     * An empty list fans out on the calling thread, this also
+     * needs to be set before the io contexts are destroyed.
+     * @param io_ctxs The io contexts to use.
+     */
+    void set_fanout_ctxs(const std::vector<boost::asio::io_context *> &io_ctxs)
+    {
+        m_fanout_strands.clear();
+        if (io_ctxs.empty())
+            return;
+        for (std::size_t i = 0; i < config::registry_shards; ++i)
+            m_fanout_strands.emplace_back(
+                boost::asio::make_strand(*io_ctxs[i % io_ctxs.size()]));
+    }
+
+    /**
+     * Removes the queued requests of all bulkheads & the
+     * fair scheduler, which releases the sessions waiting on them.
+     */
+    void clear_bulkheads()
+    {
+        for (auto &func : bound_funcs)
+            if (func.second.limit)
+                func.second.limit->clear();
+        scheduler.clear();
     }
 
     /**
@@ -654,19 +1416,11 @@ class session_manager : public std::enable_shared_from_this<session_manager>
     std::vector<uint64_t> get_session_ids()
     {
         std::vector<uint64_t> ids;
-        std::unique_lock<std::mutex> plain_lock(m_plain_mtx);
-#ifdef RADRPC_SSL_SUPPORT
-        std::unique_lock<std::mutex> ssl_lock(m_ssl_mtx);
-        ids.reserve(m_plain_sessions.size() + m_ssl_sessions.size());
-        for (const auto &id : m_plain_sessions)
-            ids.push_back(id.first);
-        for (const auto &id : m_ssl_sessions)
-            ids.push_back(id.first);
-#else
-        ids.reserve(m_plain_sessions.size());
-        for (const auto &id : m_plain_sessions)
-            ids.push_back(id.first);
-#endif
+        ids.reserve(m_sessions->size());
+        m_sessions->for_each(
+            [&ids](const session_registry::entry &session) {
+                ids.push_back(session.id);
+            });
         return ids;
     }
 };
@@ -684,7 +1438,11 @@ class session_accept
     boost::beast::flat_buffer
         m_handshake_buffer;            ///< The buffer to use for handshakes.
     StreamType m_stream;               ///< The stream to use.
-    boost::asio::steady_timer m_timer; ///< Timer for ping/pong activity.
+    std::shared_ptr<timer_wheel>
+        m_wheel; ///< The wheel of the io context for ping/pong activity.
+    timer_wheel::entry m_wheel_entry; ///< The entry scheduled on the wheel.
+    boost::asio::steady_timer
+        m_rate_timer; ///< Timer to delay rate limited requests.
     bool m_established;      ///< Used to check whether the connection was
                              ///< established.
     bool m_close;            ///< Used to check if close was already executed.
@@ -794,6 +1552,7 @@ class session_accept
             return;
         }
         m_handshake_buffer.consume(m_handshake_buffer.size());
+        m_handshake_buffer.shrink_to_fit();
 
         // Let handler inspect/configure session and allow a customized response
         // handshake
@@ -804,6 +1563,11 @@ class session_accept
                 "session_accept::on_read_handshake: Rejected connection");
             return;
         }
+        // The handler may have raised the resume watermark above the pause
+        auto &cfg = base().m_config;
+        if (cfg.read_pause_bytes != 0)
+            cfg.read_resume_bytes =
+                std::min(cfg.read_resume_bytes, cfg.read_pause_bytes);
         m_stream.read_message_max(base().m_config.max_transfer_bytes +
                                   sizeof(detail::io_header));
 
@@ -855,6 +1619,8 @@ class session_accept
                       std::placeholders::_2));
         RADRPC_LOG("server_session::on_accept: Connection established");
         m_established = true;
+        if (base().m_manager->server_cfg.compact)
+            release_handshake();
 
         // Use a custom version of ping activity instead of
         // the internal by tcp_stream,
@@ -863,15 +1629,29 @@ class session_accept
         // associated executor doesn't live long enough.
         if (base().m_config.ping_delay != duration::zero())
         {
-            m_timer.expires_after(base().m_config.ping_delay);
-            m_timer.async_wait(boost::beast::bind_front_handler(
-                &session_accept::on_timer, this->shared_from_this()));
+            m_wheel_entry.owner = this->shared_from_this();
+            m_wheel_entry.expire = &session_accept::on_expire;
+            m_wheel->schedule(m_wheel_entry, base().m_config.ping_delay);
         }
 
         base().m_manager->add_session(this->shared_from_this());
         base().read();
     }
 
+    /**
+     * Releases the handshakes & the decorator holding
+     * a copy of the response, unless they are kept.
+     */
+    void release_handshake()
+    {
+        m_stream.set_option(websocket::stream_base::decorator(
+            [](handshake_response &) {}));
+        if (base().m_config.keep_handshake)
+            return;
+        base().m_req_handshake = handshake_request();
+        base().m_res_handshake = handshake_response();
+    }
+
     /**
      * Closes the session by 'async_close()'.
      * This works by sending a close frame, waiting
@@ -882,7 +1662,11 @@ class session_accept
         if (base().m_config.ping_delay != duration::zero())
         {
             m_ping_state = ping_state::ping_close;
-            m_timer.expires_after(std::chrono::seconds(0));
+            m_wheel->cancel(m_wheel_entry);
+            boost::asio::post(m_stream.get_executor(),
+                              boost::beast::bind_front_handler(
+                                  &session_accept::on_timer,
+                                  this->shared_from_this()));
         }
         else
         {
@@ -891,32 +1675,55 @@ class session_accept
     }
 
     /**
-     * @param ec
+     * Called by the wheel with the session of an expired entry.
+     * @param owner The session to run the timer on.
      */
-    void on_timer(boost::beast::error_code ec)
+    static void on_expire(std::shared_ptr<void> owner)
     {
-        if (ec && ec != boost::asio::error::operation_aborted)
+        auto self = std::static_pointer_cast<session_accept>(owner);
+        auto executor = self->m_stream.get_executor();
+        boost::asio::post(executor,
+                          boost::beast::bind_front_handler(
+                              &session_accept::on_timer, std::move(self)));
+    }
+
+    /**
+     * Pings the client or shuts down the session if the last
+     * ping was not answered.
+     */
+    void on_timer()
+    {
+        if (m_close)
+            return;
+        // Rescheduled by a pong while the expiry was posted
+        if (m_wheel->pending(m_wheel_entry))
+            return;
+        // Also catches sessions which stall without new data
+        base().check_progress();
+        if (m_close)
             return;
-        // Check if the timer really expired since the deadline may have moved
-        if (m_timer.expiry() <= std::chrono::steady_clock::now())
+        // The pongs aren't read while reading is paused, so the ping is
+        // suspended & 'check_progress()' catches a stalled client instead
+        if (base().m_read_paused && m_ping_state != ping_state::ping_close)
         {
-            if (m_stream.is_open() && m_ping_state == ping_state::ping_next)
-            {
-                m_ping_state = ping_state::ping_send;
-                m_stream.async_ping(
-                    {},
-                    boost::beast::bind_front_handler(&session_accept::on_ping,
-                                                     this->shared_from_this()));
-            }
-            else
-            {
-                shutdown();
-                return;
-            }
+            m_ping_state = ping_state::ping_next;
+            m_wheel->schedule(m_wheel_entry, base().m_config.ping_delay);
+            return;
         }
-        m_timer.expires_after(base().m_config.ping_delay);
-        m_timer.async_wait(boost::beast::bind_front_handler(
-            &session_accept::on_timer, this->shared_from_this()));
+        if (m_stream.is_open() && m_ping_state == ping_state::ping_next)
+        {
+            m_ping_state = ping_state::ping_send;
+            m_stream.async_ping(
+                {},
+                boost::beast::bind_front_handler(&session_accept::on_ping,
+                                                 this->shared_from_this()));
+        }
+        else
+        {
+            shutdown();
+            return;
+        }
+        m_wheel->schedule(m_wheel_entry, base().m_config.ping_delay);
     }
 
     /**
@@ -943,7 +1750,39 @@ class session_accept
             return;
         }
         m_ping_state = ping_state::ping_next;
-        m_timer.expires_after(base().m_config.ping_delay);
+        if (base().m_config.ping_delay != duration::zero())
+            m_wheel->schedule(m_wheel_entry, base().m_config.ping_delay);
+    }
+
+    /**
+     * Closes the socket without a close frame, which
+     * cancels a write stalled by the client.
+     */
+    void abort_session()
+    {
+        if (m_close)
+            return;
+        m_close = true;
+        RADRPC_LOG("session_accept::abort_session");
+        boost::system::error_code ec;
+        boost::beast::get_lowest_layer(m_stream).socket().close(ec);
+        m_wheel->cancel(m_wheel_entry);
+        m_rate_timer.cancel();
+    }
+
+    /**
+     * Delays the received request, while nothing else is read.
+     * @param wait The time to wait.
+     */
+    void delay_receive(duration wait)
+    {
+        m_rate_timer.expires_after(wait);
+        m_rate_timer.async_wait([this, self{this->shared_from_this()}](
+                                    boost::beast::error_code ec) {
+            if (ec || m_close)
+                return;
+            base().receive();
+        });
     }
 
     void shutdown()
@@ -976,6 +1815,9 @@ class session_accept
      * @param p_manager The manager shared among sessions.
      * @param p_server_timeout The server timeout.
      * @param p_session_cfg The config for the session.
+     * @param p_io_ref The reference counting the sessions of the io context
+     * & the connections of the address.
+     * @param p_wheel The timer wheel of the io context.
      */
     template <typename F = StreamType>
     explicit session_accept(
@@ -984,17 +1826,20 @@ class session_accept
         const std::shared_ptr<session_manager> &p_manager,
         const server_timeout &p_server_timeout,
         const session_config &p_session_cfg,
+        ip_admission::connection_ref p_io_ref,
+        std::shared_ptr<timer_wheel> p_wheel,
         typename std::enable_if<
             std::is_same<F, server_streams::plain_stream>::value> * = nullptr) :
         server_session<session_accept<StreamType>, session_manager>(
             p_stream.socket().remote_endpoint().address().to_string(),
             p_manager,
             p_server_timeout,
-            p_session_cfg),
+            p_session_cfg,
+            std::move(p_io_ref)),
         m_handshake_buffer(std::move(p_handshake_buffer)),
         m_stream(std::move(p_stream)),
-        m_timer(m_stream.get_executor(),
-                (std::chrono::steady_clock::time_point::max)()),
+        m_wheel(std::move(p_wheel)),
+        m_rate_timer(m_stream.get_executor()),
         m_established(false),
         m_close(false),
         m_close_received(false),
@@ -1011,6 +1856,9 @@ class session_accept
      * @param p_manager The manager shared among sessions.
      * @param p_server_timeout The server timeout.
      * @param p_session_cfg The config for the session.
+     * @param p_io_ref The reference counting the sessions of the io context
+     * & the connections of the address.
+     * @param p_wheel The timer wheel of the io context.
      */
     template <typename F = StreamType>
     explicit session_accept(
@@ -1020,17 +1868,20 @@ class session_accept
         const std::shared_ptr<session_manager> &p_manager,
         const server_timeout &p_server_timeout,
         const session_config &p_session_cfg,
+        ip_admission::connection_ref p_io_ref,
+        std::shared_ptr<timer_wheel> p_wheel,
         typename std::enable_if<
             std::is_same<F, server_streams::ssl_stream>::value> * = nullptr) :
         server_session<session_accept<StreamType>, session_manager>(
             p_stream.socket().remote_endpoint().address().to_string(),
             p_manager,
             p_server_timeout,
-            p_session_cfg),
+            p_session_cfg,
+            std::move(p_io_ref)),
         m_handshake_buffer(std::move(p_handshake_buffer)),
         m_stream(std::move(p_stream), p_ssl_ctx),
-        m_timer(m_stream.get_executor(),
-                (std::chrono::steady_clock::time_point::max)()),
+        m_wheel(std::move(p_wheel)),
+        m_rate_timer(m_stream.get_executor()),
         m_established(false),
         m_close(false),
         m_close_received(false),
@@ -1042,8 +1893,9 @@ class session_accept
 
     ~session_accept()
     {
+        m_wheel->cancel(m_wheel_entry);
         if (m_established)
-            base().m_manager->template remove_session<StreamType>(base().id);
+            base().m_manager->remove_session(base().id);
         RADRPC_LOG("~session_accept: " << base().m_manager->connections());
     }
 
@@ -1072,6 +1924,11 @@ class detect_session : public std::enable_shared_from_this<detect_session>
     std::shared_ptr<session_manager>
         &m_manager;                     ///< The manager shared among sessions.
     boost::beast::flat_buffer m_buffer; ///< The buffer to read the request.
+    ip_admission::connection_ref
+        m_io_ref; ///< Counts the sessions of the used io context
+                  ///< & the connections of the address.
+    std::shared_ptr<timer_wheel>
+        m_wheel; ///< The timer wheel of the used io context.
 
   public:
     /**
@@ -1081,19 +1938,26 @@ class detect_session : public std::enable_shared_from_this<detect_session>
      * @param p_server_timeout The server timeout.
      * @param p_session_cfg The session config.
      * @param p_manager The manager shared among sessions.
+     * @param p_io_ref The reference counting the sessions of the io context
+     * & the connections of the address.
+     * @param p_wheel The timer wheel of the io context.
      */
     explicit detect_session(tcp::socket &&m_socket,
                             ssl::context &p_ssl_ctx,
                             const server_config &p_server_cfg,
                             const server_timeout &p_server_timeout,
                             const session_config &p_session_cfg,
-                            std::shared_ptr<session_manager> &p_manager) :
+                            std::shared_ptr<session_manager> &p_manager,
+                            ip_admission::connection_ref p_io_ref,
+                            std::shared_ptr<timer_wheel> p_wheel) :
         m_stream(std::move(m_socket)),
         m_ssl_ctx(p_ssl_ctx),
         m_server_cfg(p_server_cfg),
         m_server_timeout(p_server_timeout),
         m_session_cfg(p_session_cfg),
-        m_manager(p_manager)
+        m_manager(p_manager),
+        m_io_ref(std::move(p_io_ref)),
+        m_wheel(std::move(p_wheel))
     {
     }
 
@@ -1131,7 +1995,9 @@ class detect_session : public std::enable_shared_from_this<detect_session>
                 m_ssl_ctx,
                 m_manager,
                 m_server_timeout,
-                m_session_cfg)
+                m_session_cfg,
+                std::move(m_io_ref),
+                std::move(m_wheel))
                 ->accept();
         }
         else if (!result && m_server_cfg.mode & server_mode::plain)
@@ -1141,7 +2007,9 @@ class detect_session : public std::enable_shared_from_this<detect_session>
                 std::move(m_buffer),
                 m_manager,
                 m_server_timeout,
-                m_session_cfg)
+                m_session_cfg,
+                std::move(m_io_ref),
+                std::move(m_wheel))
                 ->accept();
         }
     }
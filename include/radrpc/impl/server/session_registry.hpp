@@ -0,0 +1,428 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+
+#ifndef RADRPC_IMPL_SERVER_SESSION_REGISTRY_HPP
+#define RADRPC_IMPL_SERVER_SESSION_REGISTRY_HPP
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <radrpc/config.hpp>
+#include <radrpc/debug.hpp>
+#include <radrpc/detail/data.hpp>
+
+namespace radrpc {
+namespace impl {
+namespace server {
+
+/**
+ * Tracks plain & ssl sessions in one registry.
+ * The sessions are split into shards, each holding an immutable
+ * snapshot sorted by id. Adding or removing a session copies the
+ * snapshot of its shard (copy-on-write), while readers only load
+ * the current snapshot & iterate it without locking or copying.
+ * The subscribers of each topic are indexed by one snapshot the same
+ * way, so a publish loads it once & only visits the subscribers, while
+ * subscribing copies the index & the subscribers of the topic.
+ */
+class session_registry
+{
+  public:
+    /**
+     * A type-erased session in the registry.
+     */
+    struct entry
+    {
+        uint64_t id;                 ///< The id of the session.
+        std::weak_ptr<void> session; ///< The session, expired if closed.
+        bool (*send_func)(void *, const std::shared_ptr<detail::data_push> &);
+
+        /**
+         * Sends the data if the session is still alive.
+         * A just closed session is skipped, it can't exceed its budget.
+         * @param data The data to send.
+         * @return True if sent or the session expired,
+         * false if the session rejected the data.
+         */
+        bool send(const std::shared_ptr<detail::data_push> &data) const
+        {
+            auto p = session.lock();
+            if (!p)
+                return true;
+            return send_func(p.get(), data);
+        }
+    };
+
+    typedef std::vector<entry> snapshot;
+    typedef std::unordered_map<std::string, std::shared_ptr<const snapshot>>
+        topic_index;
+
+  private:
+    /**
+     * A part of the registry with its own lock for writers.
+     */
+    struct shard
+    {
+        std::mutex mtx; ///< Serializes the writers of this shard.
+        std::shared_ptr<const snapshot>
+            sessions; ///< The current snapshot, replaced on each write.
+        std::unordered_map<uint64_t, std::vector<std::string>>
+            subscriptions; ///< The topics of each session in this shard.
+    };
+
+    std::array<shard, config::registry_shards> m_shards; ///< The shards.
+    std::mutex m_topics_mtx; ///< Serializes the writers of the topic index.
+    std::shared_ptr<const topic_index>
+        m_topics; ///< The subscribers of each topic, replaced on each write.
+
+    /**
+     * @tparam Session The type of the session.
+     */
+    template <typename Session>
+    static bool send_to(void *session,
+                        const std::shared_ptr<detail::data_push> &data)
+    {
+        return static_cast<Session *>(session)->send(data);
+    }
+
+    static bool entry_less(const entry &lhs, uint64_t id)
+    {
+        return lhs.id < id;
+    }
+
+    /**
+     * Returns the shard of the session id.
+     * The ids are addresses, hence they are mixed before.
+     * @param id The session id.
+     * @return The shard.
+     */
+    shard &shard_of(uint64_t id)
+    {
+        return m_shards[(id * 0x9E3779B97F4A7C15ull >> 32) %
+                        config::registry_shards];
+    }
+
+    /**
+     * Replaces the snapshot of a shard with a modified copy.
+     * The lock of the shard must be held.
+     * @param s The shard to modify.
+     * @param modify Called with the copy to modify.
+     */
+    template <typename Modify> static void update(shard &s, Modify &&modify)
+    {
+        auto next = std::make_shared<snapshot>(*s.sessions);
+        modify(*next);
+        std::atomic_store(&s.sessions,
+                          std::shared_ptr<const snapshot>(std::move(next)));
+    }
+
+    /**
+     * Replaces the topic index with a modified copy.
+     * The lock of the shard of the session must be held.
+     * @param modify Called with the copy to modify.
+     */
+    template <typename Modify> void update_topics(Modify &&modify)
+    {
+        std::unique_lock<std::mutex> lock(m_topics_mtx);
+        auto next = std::make_shared<topic_index>(*m_topics);
+        modify(*next);
+        std::atomic_store(&m_topics,
+                          std::shared_ptr<const topic_index>(std::move(next)));
+    }
+
+    /**
+     * Finds the entry of a session.
+     * The lock of the shard must be held.
+     * @param s The shard of the session.
+     * @param id The id of the session.
+     * @param found The found entry.
+     * @return True if found, false if not.
+     */
+    static bool find(const shard &s, uint64_t id, entry &found)
+    {
+        const auto &sessions = *s.sessions;
+        auto itr =
+            std::lower_bound(sessions.begin(), sessions.end(), id, &entry_less);
+        if (itr == sessions.end() || itr->id != id)
+            return false;
+        found = *itr;
+        return true;
+    }
+
+    /**
+     * Removes a session from the subscribers of a topic.
+     * @param topics The topic index to modify.
+     * @param id The id of the session.
+     * @param topic The topic to remove the session from.
+     */
+    static void remove_subscriber(topic_index &topics,
+                                  uint64_t id,
+                                  const std::string &topic)
+    {
+        auto topic_itr = topics.find(topic);
+        if (topic_itr == topics.end())
+            return;
+        auto next = std::make_shared<snapshot>(*topic_itr->second);
+        auto itr =
+            std::lower_bound(next->begin(), next->end(), id, &entry_less);
+        if (itr != next->end() && itr->id == id)
+            next->erase(itr);
+        if (next->empty())
+            topics.erase(topic_itr);
+        else
+            topic_itr->second = std::move(next);
+    }
+
+  public:
+    session_registry() : m_topics(std::make_shared<const topic_index>())
+    {
+        for (auto &s : m_shards)
+            s.sessions = std::make_shared<const snapshot>();
+    }
+
+    /**
+     * Adds or replaces a session.
+     * @tparam Session The type of the session providing 'send()'.
+     * @param id The id of the session.
+     * @param session The session to add.
+     */
+    template <typename Session>
+    void add(uint64_t id, const std::shared_ptr<Session> &session)
+    {
+        auto &s = shard_of(id);
+        std::unique_lock<std::mutex> lock(s.mtx);
+        update(s, [&](snapshot &sessions) {
+            auto itr = std::lower_bound(
+                sessions.begin(), sessions.end(), id, &entry_less);
+            entry e{id, session, &send_to<Session>};
+            if (itr != sessions.end() && itr->id == id)
+                *itr = std::move(e);
+            else
+                sessions.insert(itr, std::move(e));
+        });
+    }
+
+    /**
+     * Removes a session & its subscriptions.
+     * @param id The id of the session to remove.
+     */
+    void remove(uint64_t id)
+    {
+        auto &s = shard_of(id);
+        std::unique_lock<std::mutex> lock(s.mtx);
+        update(s, [&](snapshot &sessions) {
+            auto itr = std::lower_bound(
+                sessions.begin(), sessions.end(), id, &entry_less);
+            if (itr != sessions.end() && itr->id == id)
+                sessions.erase(itr);
+        });
+        auto subscription_itr = s.subscriptions.find(id);
+        if (subscription_itr == s.subscriptions.end())
+            return;
+        update_topics([&](topic_index &topics) {
+            for (const auto &topic : subscription_itr->second)
+                remove_subscriber(topics, id, topic);
+        });
+        s.subscriptions.erase(subscription_itr);
+    }
+
+    /**
+     * Subscribes a session to a topic.
+     * The session is looked up under the same lock as 'remove()',
+     * so a closing session can't leave a subscription behind.
+     * @param id The id of the session.
+     * @param topic The topic to subscribe to.
+     * @return True if subscribed, false if the session is not registered.
+     */
+    bool subscribe(uint64_t id, const std::string &topic)
+    {
+        auto &s = shard_of(id);
+        std::unique_lock<std::mutex> lock(s.mtx);
+        entry e;
+        if (!find(s, id, e))
+            return false;
+        auto &topics = s.subscriptions[id];
+        if (std::find(topics.begin(), topics.end(), topic) != topics.end())
+            return true;
+        topics.push_back(topic);
+        update_topics([&](topic_index &index) {
+            auto &subscribers = index[topic];
+            auto next = subscribers ? std::make_shared<snapshot>(*subscribers)
+                                    : std::make_shared<snapshot>();
+            next->insert(
+                std::lower_bound(next->begin(), next->end(), id, &entry_less),
+                std::move(e));
+            subscribers = std::move(next);
+        });
+        return true;
+    }
+
+    /**
+     * Unsubscribes a session from a topic.
+     * @param id The id of the session.
+     * @param topic The topic to unsubscribe from.
+     * @return True if unsubscribed, false if it was not subscribed.
+     */
+    bool unsubscribe(uint64_t id, const std::string &topic)
+    {
+        auto &s = shard_of(id);
+        std::unique_lock<std::mutex> lock(s.mtx);
+        auto subscription_itr = s.subscriptions.find(id);
+        if (subscription_itr == s.subscriptions.end())
+            return false;
+        auto &topics = subscription_itr->second;
+        auto topic_itr = std::find(topics.begin(), topics.end(), topic);
+        if (topic_itr == topics.end())
+            return false;
+        topics.erase(topic_itr);
+        if (topics.empty())
+            s.subscriptions.erase(subscription_itr);
+        update_topics([&](topic_index &topics) {
+            remove_subscriber(topics, id, topic);
+        });
+        return true;
+    }
+
+    /**
+     * Returns the subscribers of a topic without locking.
+     * A concurrent write doesn't affect the returned snapshot.
+     * @param topic The topic to look up.
+     * @return The subscribers, nullptr if there are none.
+     */
+    std::shared_ptr<const snapshot> subscribers_of(const std::string &topic)
+    {
+        auto topics = std::atomic_load(&m_topics);
+        auto topic_itr = topics->find(topic);
+        if (topic_itr == topics->end())
+            return nullptr;
+        return topic_itr->second;
+    }
+
+    /**
+     * Calls the function with each subscriber of a topic.
+     * @param topic The topic to look up.
+     * @param f The function to call with each entry.
+     */
+    template <typename Function>
+    void for_each_subscriber(const std::string &topic, Function &&f)
+    {
+        if (auto subscribers = subscribers_of(topic))
+        {
+            for (const auto &e : *subscribers)
+                f(e);
+        }
+    }
+
+    /**
+     * Returns the amount of subscribers of a topic.
+     * @param topic The topic to look up.
+     * @return The amount of subscribers.
+     */
+    std::size_t subscribers(const std::string &topic)
+    {
+        auto subscribers = subscribers_of(topic);
+        return subscribers ? subscribers->size() : 0;
+    }
+
+    /**
+     * Calls the function with each session.
+     * A concurrent write doesn't affect the iterated snapshots.
+     * @param f The function to call with each entry.
+     */
+    template <typename Function> void for_each(Function &&f)
+    {
+        for (auto &s : m_shards)
+        {
+            auto sessions = std::atomic_load(&s.sessions);
+            for (const auto &e : *sessions)
+                f(e);
+        }
+    }
+
+    /**
+     * Calls the function with each session of a shard.
+     * @param index The index of the shard.
+     * @param f The function to call with each entry.
+     */
+    template <typename Function>
+    void for_each_in_shard(std::size_t index, Function &&f)
+    {
+        auto sessions = std::atomic_load(&m_shards[index].sessions);
+        for (const auto &e : *sessions)
+            f(e);
+    }
+
+    /**
+     * Returns the amount of sessions in a shard.
+     * @param index The index of the shard.
+     * @return The amount of sessions.
+     */
+    std::size_t shard_size(std::size_t index)
+    {
+        return std::atomic_load(&m_shards[index].sessions)->size();
+    }
+
+    /**
+     * Calls the function with each session of the given ids.
+     * Ids which are not registered are skipped.
+     * @param session_ids The session ids to look up.
+     * @param f The function to call with each entry.
+     */
+    template <typename StlContainer, typename Function>
+    void for_each(const StlContainer &session_ids, Function &&f)
+    {
+        for (const auto &id : session_ids)
+        {
+            auto sessions = std::atomic_load(&shard_of(id).sessions);
+            auto itr = std::lower_bound(
+                sessions->begin(), sessions->end(), id, &entry_less);
+            if (itr != sessions->end() && itr->id == id)
+                f(*itr);
+        }
+    }
+
+    /**
+     * Returns the amount of registered sessions.
+     * @return The amount of sessions.
+     */
+    std::size_t size()
+    {
+        std::size_t count = 0;
+        for (auto &s : m_shards)
+            count += std::atomic_load(&s.sessions)->size();
+        return count;
+    }
+};
+
+} // namespace server
+} // namespace impl
+} // namespace radrpc
+
+#endif // RADRPC_IMPL_SERVER_SESSION_REGISTRY_HPP
@@ -0,0 +1,316 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#ifndef RADRPC_IMPL_SERVER_TIMER_WHEEL_HPP
+#define RADRPC_IMPL_SERVER_TIMER_WHEEL_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core/bind_handler.hpp>
+
+#include <radrpc/config.hpp>
+#include <radrpc/debug.hpp>
+
+namespace radrpc {
+namespace impl {
+namespace server {
+
+/**
+ * A hierarchical timer wheel shared by the sessions of an io context.
+ * Scheduling & cancelling an entry are O(1) & only relink it, a single
+ * steady timer ticks while entries are scheduled & expires them in
+ * batches. Each level has 64 slots, the entries of a slot in a higher
+ * level are cascaded down once the lower level wrapped around.
+ */
+class timer_wheel : public std::enable_shared_from_this<timer_wheel>
+{
+  public:
+    /**
+     * The handler to call with the owner of an expired entry.
+     */
+    typedef void (*expire_handler)(std::shared_ptr<void> owner);
+
+    /**
+     * An intrusive entry, which is owned by the scheduled object.
+     */
+    struct entry
+    {
+        entry *next;   ///< The next entry in the slot.
+        entry **pprev; ///< The link pointing to this entry.
+        uint64_t deadline; ///< The tick to expire at, zero if not scheduled.
+        std::weak_ptr<void> owner; ///< The owner to keep alive on expiry.
+        expire_handler expire;     ///< The handler to call on expiry.
+
+        entry() :
+            next(nullptr),
+            pprev(nullptr),
+            deadline(0),
+            owner(),
+            expire(nullptr)
+        {
+        }
+    };
+
+  private:
+    static constexpr unsigned int slot_bits = 6; ///< The bits per level.
+    static constexpr unsigned int slots = 1 << slot_bits; ///< Per level.
+    static constexpr unsigned int levels = 4; ///< The amount of levels.
+
+    const duration m_resolution;      ///< The duration of a tick.
+    const time_point m_start;         ///< The time of the tick zero.
+    boost::asio::steady_timer m_timer; ///< Ticks while entries are scheduled.
+    std::mutex m_mtx;   ///< Lock, since the sessions may run on strands.
+    uint64_t m_tick;    ///< The last processed tick.
+    std::size_t m_size; ///< The amount of scheduled entries.
+    bool m_ticking;     ///< Whether the timer is armed.
+    std::array<std::array<entry *, slots>, levels>
+        m_slots; ///< The heads of the slots by level.
+    std::vector<std::pair<std::shared_ptr<void>, expire_handler>>
+        m_expired; ///< The expired entries of a tick, to call unlocked.
+
+    /**
+     * @param level The level of the wheel.
+     * @return The ticks covered by a slot of the level.
+     */
+    static uint64_t span(unsigned int level)
+    {
+        return uint64_t(1) << (slot_bits * level);
+    }
+
+    /**
+     * @param now The time to convert.
+     * @return The ticks since the start, rounded down.
+     */
+    uint64_t tick_of(time_point now) const
+    {
+        return static_cast<uint64_t>((now - m_start) / m_resolution);
+    }
+
+    /**
+     * Links an entry into the slot of its deadline.
+     * @param e The entry to link.
+     */
+    void link(entry &e)
+    {
+        // Deadlines beyond the last level are cascaded again
+        auto delta = (std::min)(e.deadline - m_tick, span(levels) - 1);
+        auto at = m_tick + delta;
+        unsigned int level = 0;
+        while (level + 1 < levels && delta >= span(level + 1))
+            ++level;
+        auto &head = m_slots[level][(at >> (slot_bits * level)) & (slots - 1)];
+        e.next = head;
+        e.pprev = &head;
+        if (head)
+            head->pprev = &e.next;
+        head = &e;
+    }
+
+    /**
+     * Unlinks a linked entry.
+     * @param e The entry to unlink.
+     */
+    void unlink(entry &e)
+    {
+        *e.pprev = e.next;
+        if (e.next)
+            e.next->pprev = e.pprev;
+        e.next = nullptr;
+        e.pprev = nullptr;
+    }
+
+    /**
+     * Relinks all entries of a slot.
+     * @param level The level of the slot.
+     * @param index The index of the slot.
+     */
+    void cascade(unsigned int level, std::size_t index)
+    {
+        auto e = m_slots[level][index];
+        m_slots[level][index] = nullptr;
+        while (e)
+        {
+            auto next = e->next;
+            if (e->deadline <= m_tick)
+                expire(*e);
+            else
+                link(*e);
+            e = next;
+        }
+    }
+
+    /**
+     * Removes an entry & collects its owner.
+     * @param e The entry to expire.
+     */
+    void expire(entry &e)
+    {
+        e.next = nullptr;
+        e.pprev = nullptr;
+        e.deadline = 0;
+        --m_size;
+        auto owner = e.owner.lock();
+        if (owner)
+            m_expired.emplace_back(std::move(owner), e.expire);
+    }
+
+    /**
+     * Processes the ticks until now & calls the expired handlers.
+     * @param ec
+     */
+    void on_tick(boost::system::error_code ec)
+    {
+        if (ec)
+            return;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            auto target = tick_of(std::chrono::steady_clock::now());
+            while (m_tick < target && m_size != 0)
+            {
+                ++m_tick;
+                for (unsigned int level = 1; level < levels; ++level)
+                {
+                    if ((m_tick & (span(level) - 1)) != 0)
+                        break;
+                    cascade(level,
+                            (m_tick >> (slot_bits * level)) & (slots - 1));
+                }
+                cascade(0, m_tick & (slots - 1));
+            }
+            if (m_size == 0)
+            {
+                m_tick = (std::max)(m_tick, target);
+                m_ticking = false;
+            }
+            else
+            {
+                arm();
+            }
+        }
+        for (auto &expired : m_expired)
+            expired.second(std::move(expired.first));
+        m_expired.clear();
+    }
+
+    /**
+     * Arms the timer for the next tick.
+     */
+    void arm()
+    {
+        m_ticking = true;
+        m_timer.expires_at(m_start + m_resolution * (m_tick + 1));
+        m_timer.async_wait(boost::beast::bind_front_handler(
+            &timer_wheel::on_tick, shared_from_this()));
+    }
+
+  public:
+    /**
+     * @param p_executor The executor to tick on.
+     * @param p_resolution The duration of a tick.
+     */
+    template <typename Executor>
+    timer_wheel(const Executor &p_executor, duration p_resolution) :
+        m_resolution((std::max)(p_resolution, duration(1))),
+        m_start(std::chrono::steady_clock::now()),
+        m_timer(p_executor),
+        m_tick(0),
+        m_size(0),
+        m_ticking(false),
+        m_slots()
+    {
+    }
+
+    /**
+     * Schedules or reschedules an entry.
+     * [thread-safe]
+     * @param e The entry, its owner & handler must be set.
+     * @param after The time until it expires.
+     */
+    void schedule(entry &e, duration after)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        auto now = std::chrono::steady_clock::now();
+        if (!m_ticking)
+            m_tick = (std::max)(m_tick, tick_of(now));
+        if (e.deadline != 0)
+            unlink(e);
+        else
+            ++m_size;
+        // Rounded up, so it never expires early
+        e.deadline = (std::max)(m_tick + 1, tick_of(now + after) + 1);
+        link(e);
+        if (!m_ticking)
+            arm();
+    }
+
+    /**
+     * Cancels an entry, which may be already expired.
+     * [thread-safe]
+     * @param e The entry to cancel.
+     */
+    void cancel(entry &e)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (e.deadline == 0)
+            return;
+        unlink(e);
+        e.deadline = 0;
+        --m_size;
+    }
+
+    /**
+     * Checks whether an entry is scheduled.
+     * [thread-safe]
+     * @param e The entry to check.
+     * @return True if scheduled, false if expired or cancelled.
+     */
+    bool pending(const entry &e)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        return e.deadline != 0;
+    }
+
+    /**
+     * @return The amount of scheduled entries.
+     */
+    std::size_t size()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        return m_size;
+    }
+};
+
+} // namespace server
+} // namespace impl
+} // namespace radrpc
+
+#endif // RADRPC_IMPL_SERVER_TIMER_WHEEL_HPP
@@ -25,6 +25,7 @@
 #ifndef RADRPC_SERVER_HPP
 #define RADRPC_SERVER_HPP
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <functional>
@@ -34,9 +35,12 @@
 #include <utility>
 #include <vector>
 
+#include <boost/asio/executor_work_guard.hpp>
 #include <boost/asio/signal_set.hpp>
 
 #include <radrpc/types.hpp>
+#include <radrpc/detail/busy_poll.hpp>
+#include <radrpc/detail/placement.hpp>
 #include <radrpc/impl/server/listener.hpp>
 
 namespace radrpc {
@@ -54,13 +58,27 @@ class server
     std::mutex m_mtx;                  ///< Common lock.
     bool m_running;     ///< Used to check whether IO and workers are running
     bool m_async_start; ///< Used for check if server was asynchron started
+    unsigned int m_worker_count; ///< The amount of workers to run.
     unsigned int
-        m_workers_done; ///< Determine the amount of workers finished execution.
+        m_workers_running; ///< The amount of started & not finished workers.
+    std::atomic<unsigned int>
+        m_workers_retire; ///< The amount of workers which need to retire.
+    std::vector<std::thread::id>
+        m_workers_retired; ///< The retired workers which need to be joined.
+    std::function<void()>
+        m_io_stopped_handler; ///< Called if the io stopped on all workers.
     const server_config m_server_cfg;      ///< The server config.
+    const std::vector<std::vector<unsigned int>>
+        m_placement_nodes; ///< The topology to place the workers on.
     const server_timeout m_server_timeout; ///< The server timeout.
     const session_config m_session_cfg;    ///< The default session config.
     std::shared_ptr<impl::server::session_manager>
         m_manager; ///< The manager shared among sessions.
+    std::vector<std::unique_ptr<boost::asio::io_context>>
+        m_worker_ctxs; ///< The additional io contexts in per worker mode.
+    std::vector<boost::asio::executor_work_guard<
+        boost::asio::io_context::executor_type>>
+        m_worker_guards; ///< Keeps the additional io contexts running.
     boost::asio::io_context m_io_ctx;      ///< The io context.
     std::shared_ptr<impl::server::listener>
         m_listener; ///< The listener to accept new conenctions.
@@ -68,6 +86,194 @@ class server
     std::vector<std::thread>
         m_workers; ///< Workers which are running the io context.
 
+    /**
+     * Creates the additional io contexts for the per worker mode.
+     * The first worker uses the main io context.
+     * @param p_server_cfg The server config.
+     * @return The additional io contexts.
+     */
+    static std::vector<std::unique_ptr<boost::asio::io_context>>
+    create_worker_ctxs(const server_config &p_server_cfg)
+    {
+        std::vector<std::unique_ptr<boost::asio::io_context>> io_ctxs;
+        if (p_server_cfg.io_mode != server_io_mode::per_worker)
+            return io_ctxs;
+        for (auto i = 1u; i < p_server_cfg.workers; ++i)
+            io_ctxs.emplace_back(new boost::asio::io_context(1));
+        return io_ctxs;
+    }
+
+    /**
+     * Returns the io contexts to pin the sessions to.
+     * This is empty if all workers run the main io context.
+     * @return The io contexts for the sessions.
+     */
+    std::vector<boost::asio::io_context *> session_ctxs()
+    {
+        std::vector<boost::asio::io_context *> io_ctxs;
+        if (m_server_cfg.io_mode != server_io_mode::per_worker)
+            return io_ctxs;
+        io_ctxs.push_back(&m_io_ctx);
+        for (auto &io_ctx : m_worker_ctxs)
+            io_ctxs.push_back(io_ctx.get());
+        return io_ctxs;
+    }
+
+    /**
+     * Returns the io contexts to fan out the broadcasts on.
+     * @return The io contexts for the broadcasts.
+     */
+    std::vector<boost::asio::io_context *> fanout_ctxs()
+    {
+        auto io_ctxs = session_ctxs();
+        if (io_ctxs.empty())
+            io_ctxs.push_back(&m_io_ctx);
+        return io_ctxs;
+    }
+
+    /**
+     * Returns the io context to run by the worker.
+     * @param worker The index of the worker, 0 is the main io context.
+     * @return The io context to run.
+     */
+    boost::asio::io_context &worker_ctx(unsigned int worker)
+    {
+        if (worker == 0 || m_worker_ctxs.empty())
+            return m_io_ctx;
+        return *m_worker_ctxs[worker - 1];
+    }
+
+    /**
+     * Stops all io contexts.
+     */
+    void stop_io()
+    {
+        m_io_ctx.stop();
+        for (auto &io_ctx : m_worker_ctxs)
+            io_ctx->stop();
+    }
+
+    /**
+     * Checks whether the caller is one of the workers.
+     * @return True if called from a worker, false if not.
+     */
+    bool running_in_workers()
+    {
+        if (m_io_ctx.get_executor().running_in_this_thread())
+            return true;
+        for (auto &io_ctx : m_worker_ctxs)
+            if (io_ctx->get_executor().running_in_this_thread())
+                return true;
+        return false;
+    }
+
+    /**
+     * Returns the flag of the calling worker to leave its io context.
+     * @return The flag, nullptr if not called by a worker.
+     */
+    static bool *&retire_flag()
+    {
+        static thread_local bool *flag = nullptr;
+        return flag;
+    }
+
+    /**
+     * Starts a worker which runs the io context.
+     * @param io_ctx The io context to run.
+     * @param index The index of the worker used for its placement.
+     */
+    void spawn_worker(boost::asio::io_context &io_ctx, unsigned int index)
+    {
+        {
+            std::unique_lock<std::mutex> worker_lock(m_stop_mtx);
+            ++m_workers_running;
+        }
+        m_workers.emplace_back([this, &io_ctx, index] {
+            RADRPC_LOG("server::spawn_worker: Worker " << index << " started");
+            detail::apply_placement(
+                m_server_cfg.placement, m_placement_nodes, index);
+            detail::buffer_pool::worker_scope buffers(m_manager->buffers);
+            bool retired = false;
+            retire_flag() = &retired;
+            detail::run_busy_poll(io_ctx, m_server_cfg.spin_budget, &retired);
+            retire_flag() = nullptr;
+            if (retired)
+            {
+                RADRPC_LOG("server::spawn_worker: Worker retired");
+                std::unique_lock<std::mutex> worker_lock(m_stop_mtx);
+                m_workers_retired.push_back(std::this_thread::get_id());
+                --m_workers_running;
+                m_cv_stop.notify_all();
+                return;
+            }
+            RADRPC_LOG("server::spawn_worker: Worker done");
+            bool notify;
+            {
+                std::unique_lock<std::mutex> worker_lock(m_stop_mtx);
+                notify = --m_workers_running == 0;
+            }
+            if (notify)
+            {
+                RADRPC_LOG("server::spawn_worker: IO has been stopped "
+                           "on workers");
+                m_cv_stop.notify_all();
+                if (m_io_stopped_handler)
+                    m_io_stopped_handler();
+            }
+        });
+    }
+
+    /**
+     * Lets the executing worker leave the io context after
+     * this handler, if there are still workers to retire.
+     * This function must be called within the executor context.
+     */
+    void retire_worker()
+    {
+        auto retire = m_workers_retire.load();
+        if (retire == 0)
+            return;
+        // The caller of 'start()' is not part of the workers.
+        auto flag = retire_flag();
+        if (!flag)
+        {
+            boost::asio::post(m_io_ctx, [this] { retire_worker(); });
+            return;
+        }
+        while (retire != 0)
+        {
+            if (m_workers_retire.compare_exchange_weak(retire, retire - 1))
+            {
+                *flag = true;
+                return;
+            }
+        }
+    }
+
+    /**
+     * Joins the retired workers.
+     * This function must be called with the common lock.
+     */
+    void join_retired_workers()
+    {
+        std::vector<std::thread::id> retired;
+        {
+            std::unique_lock<std::mutex> worker_lock(m_stop_mtx);
+            retired.swap(m_workers_retired);
+        }
+        for (const auto &id : retired)
+        {
+            auto worker_itr = std::find_if(
+                m_workers.begin(), m_workers.end(), [&](std::thread &worker) {
+                    return worker.get_id() == id;
+                });
+            if (worker_itr == m_workers.end())
+                continue;
+            worker_itr->join();
+            m_workers.erase(worker_itr);
+        }
+    }
+
     /**
      * Run a specific amount of workers without blocking.
      */
@@ -76,35 +282,22 @@ class server
     {
         if (m_io_ctx.stopped())
             m_io_ctx.restart();
-        m_workers = std::vector<std::thread>();
+        // The additional io contexts have no pending work
+        // unless a session was pinned to it.
+        for (auto &io_ctx : m_worker_ctxs)
         {
-            std::unique_lock<std::mutex> worker_lock(m_stop_mtx);
-            m_workers_done = 0;
+            if (io_ctx->stopped())
+                io_ctx->restart();
+            m_worker_guards.push_back(boost::asio::make_work_guard(*io_ctx));
         }
-        auto workers =
-            m_async_start ? m_server_cfg.workers : m_server_cfg.workers - 1;
+        m_workers = std::vector<std::thread>();
+        m_io_stopped_handler = io_stopped_handler;
+        auto workers = m_async_start ? m_worker_count : m_worker_count - 1;
         for (auto i = workers; i > 0; --i)
         {
-            m_workers.emplace_back([this, i, workers, io_stopped_handler] {
-                RADRPC_LOG("server::run_async_workers: Worker " << i
-                                                                << " started");
-                m_io_ctx.run();
-                RADRPC_LOG("server::run_async_workers: Worker " << i
-                                                                << " done");
-                bool notify;
-                {
-                    std::unique_lock<std::mutex> worker_lock(m_stop_mtx);
-                    notify = ++m_workers_done == workers;
-                }
-                if (notify)
-                {
-                    RADRPC_LOG("server::run_async_workers: IO has been stopped "
-                               "on workers");
-                    m_cv_stop.notify_all();
-                    if (io_stopped_handler)
-                        io_stopped_handler();
-                }
-            });
+            // If blocking, the caller runs the main io context.
+            auto index = m_async_start ? i - 1 : i;
+            spawn_worker(worker_ctx(index), index);
         }
     }
 
@@ -115,7 +308,22 @@ class server
     void on_signal(const boost::system::error_code &ec, int signal_code)
     {
         RADRPC_LOG("server::on_signal: " << signal_code);
-        m_io_ctx.stop();
+        stop_io();
+    }
+
+    /**
+     * Checks the default session config.
+     * @param cfg The session config to check.
+     * @return The session config.
+     */
+    static const session_config &
+    checked_session_cfg(const session_config &cfg)
+    {
+        if (cfg.read_pause_bytes != 0 &&
+            cfg.read_resume_bytes > cfg.read_pause_bytes)
+            RADRPC_THROW("server::server: 'read_resume_bytes' must not "
+                         "exceed 'read_pause_bytes'");
+        return cfg;
     }
 
   public:
@@ -132,15 +340,22 @@ class server
 #endif
         m_running(false),
         m_async_start(false),
-        m_workers_done(0),
+        m_worker_count(p_server_cfg.workers),
+        m_workers_running(0),
+        m_workers_retire(0),
         m_server_cfg(p_server_cfg),
+        m_placement_nodes(detail::placement_nodes(p_server_cfg.placement)),
         m_server_timeout(p_server_timeout),
-        m_session_cfg(p_session_cfg),
+        m_session_cfg(checked_session_cfg(p_session_cfg)),
         m_manager(
             std::make_shared<impl::server::session_manager>(p_server_cfg)),
-        m_io_ctx(p_server_cfg.workers),
+        m_worker_ctxs(create_worker_ctxs(p_server_cfg)),
+        m_io_ctx(p_server_cfg.io_mode == server_io_mode::per_worker
+                     ? 1
+                     : p_server_cfg.workers),
         m_listener(std::make_shared<impl::server::listener>(
             m_io_ctx,
+            session_ctxs(),
 #ifdef RADRPC_SSL_SUPPORT
             nullptr,
 #endif
@@ -154,6 +369,8 @@ class server
         m_signals(m_io_ctx, SIGINT, SIGTERM)
     {
         RADRPC_LOG("+server");
+        if (m_server_cfg.parallel_broadcast)
+            m_manager->set_fanout_ctxs(fanout_ctxs());
         m_listener->run();
         m_signals.async_wait(std::bind(&server::on_signal,
                                        this,
@@ -175,15 +392,22 @@ class server
         m_ssl_ctx(std::move(p_ssl_ctx)),
         m_running(false),
         m_async_start(false),
-        m_workers_done(0),
+        m_worker_count(p_server_cfg.workers),
+        m_workers_running(0),
+        m_workers_retire(0),
         m_server_cfg(p_server_cfg),
+        m_placement_nodes(detail::placement_nodes(p_server_cfg.placement)),
         m_server_timeout(p_server_timeout),
-        m_session_cfg(p_session_cfg),
+        m_session_cfg(checked_session_cfg(p_session_cfg)),
         m_manager(
             std::make_shared<impl::server::session_manager>(p_server_cfg)),
-        m_io_ctx(p_server_cfg.workers),
+        m_worker_ctxs(create_worker_ctxs(p_server_cfg)),
+        m_io_ctx(p_server_cfg.io_mode == server_io_mode::per_worker
+                     ? 1
+                     : p_server_cfg.workers),
         m_listener(std::make_shared<impl::server::listener>(
             m_io_ctx,
+            session_ctxs(),
             &m_ssl_ctx,
             tcp::endpoint{
                 boost::asio::ip::make_address(p_server_cfg.host_address),
@@ -195,6 +419,8 @@ class server
         m_signals(m_io_ctx, SIGINT, SIGTERM)
     {
         RADRPC_LOG("+server");
+        if (m_server_cfg.parallel_broadcast)
+            m_manager->set_fanout_ctxs(fanout_ctxs());
         m_listener->run();
         m_signals.async_wait(std::bind(&server::on_signal,
                                        this,
@@ -207,6 +433,8 @@ class server
     {
         RADRPC_LOG("~server");
         stop();
+        // The manager may outlive the io contexts.
+        m_manager->set_fanout_ctxs({});
     }
 
     /**
@@ -230,7 +458,8 @@ class server
         }
 
         RADRPC_LOG("server::start: Run blocking IO context");
-        m_io_ctx.run();
+        detail::buffer_pool::worker_scope buffers(m_manager->buffers);
+        detail::run_busy_poll(m_io_ctx, m_server_cfg.spin_budget);
 
         // SIGINT, SIGTERM, m_io_ctx.stop()
         RADRPC_LOG("server::start: Blocking IO context has been stopped");
@@ -264,23 +493,20 @@ class server
      */
     void stop()
     {
-        if (m_io_ctx.get_executor().running_in_this_thread())
+        if (running_in_workers())
         {
             RADRPC_LOG("server::stop: Called from IO worker");
-            std::thread([&] { m_io_ctx.stop(); }).join();
+            std::thread([&] { stop_io(); }).join();
         }
         else
         {
             RADRPC_LOG("server::stop");
-            m_io_ctx.stop();
+            stop_io();
             std::unique_lock<std::mutex> lock(m_mtx);
             if (!m_running)
                 return;
-            auto workers =
-                m_async_start ? m_server_cfg.workers : m_server_cfg.workers - 1;
             std::unique_lock<std::mutex> worker_lock(m_stop_mtx);
-            m_cv_stop.wait(worker_lock,
-                           [&] { return workers == m_workers_done; });
+            m_cv_stop.wait(worker_lock, [&] { return m_workers_running == 0; });
             RADRPC_LOG("server::stop: Workers done");
             for (auto &worker : m_workers)
             {
@@ -288,20 +514,113 @@ class server
                     worker.join();
             }
             RADRPC_LOG("server::stop: Workers joined");
+            // Pending retirements are obsolete after a restart.
+            m_workers_retire = 0;
+            m_workers_retired.clear();
+            m_worker_guards.clear();
+            m_manager->clear_bulkheads();
             m_running = false;
         }
     }
 
+    /**
+     * Changes the amount of workers at runtime.
+     * Additional workers are started immediately, while the
+     * workers to remove leave the io context after their
+     * current handler, so no session or handler is interrupted.
+     * This is only supported if all workers share the io context.
+     * [thread-safe]
+     * @param workers The new amount of workers, at least 1.
+     * @return True if changed, false if the amount or io mode is invalid.
+     */
+    bool set_workers(unsigned int workers)
+    {
+        if (workers == 0 || m_server_cfg.io_mode == server_io_mode::per_worker)
+            return false;
+        std::unique_lock<std::mutex> lock(m_mtx);
+        RADRPC_LOG("server::set_workers: " << m_worker_count << " -> "
+                                           << workers);
+        if (m_running)
+        {
+            join_retired_workers();
+            for (auto i = m_worker_count; i < workers; ++i)
+                spawn_worker(m_io_ctx, i);
+            for (auto i = workers; i < m_worker_count; ++i)
+            {
+                ++m_workers_retire;
+                boost::asio::post(m_io_ctx, [this] { retire_worker(); });
+            }
+        }
+        m_worker_count = workers;
+        return true;
+    }
+
+    /**
+     * Returns the amount of workers to run.
+     * [thread-safe]
+     * @return The amount of workers.
+     */
+    unsigned int workers()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        return m_worker_count;
+    }
+
     /**
      * Broadcasts data to all sessions.
      * The message will be copied one time.
      * [thread-safe]
      * @param call_id The id to call on the clients.
      * @param send_bytes The bytes to send to the clients.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     * If 'parallel_broadcast' is set, only the server budget is checked,
+     * since the sessions are reached later on the workers.
      */
-    void broadcast(uint32_t call_id, const std::vector<char> &send_bytes)
+    bool broadcast(uint32_t call_id,
+                   const std::vector<char> &send_bytes,
+                   send_priority priority = send_priority::broadcast)
     {
-        m_manager->broadcast(call_id, send_bytes);
+        return m_manager->broadcast(call_id, send_bytes, priority);
+    }
+
+    /**
+     * Broadcasts data to all sessions.
+     * The message will be moved & not copied.
+     * [thread-safe]
+     * @param call_id The id to call on the clients.
+     * @param send_bytes The bytes to send to the clients.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     * If 'parallel_broadcast' is set, only the server budget is checked,
+     * since the sessions are reached later on the workers.
+     */
+    bool broadcast(uint32_t call_id,
+                   std::vector<char> &&send_bytes,
+                   send_priority priority = send_priority::broadcast)
+    {
+        return m_manager->broadcast(call_id, std::move(send_bytes), priority);
+    }
+
+    /**
+     * Broadcasts data to all sessions.
+     * The message is shared & must not be modified afterwards,
+     * so it can be reused for further broadcasts without copying.
+     * [thread-safe]
+     * @param call_id The id to call on the clients.
+     * @param send_bytes The bytes to send to the clients.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     * If 'parallel_broadcast' is set, only the server budget is checked,
+     * since the sessions are reached later on the workers.
+     */
+    bool broadcast(uint32_t call_id,
+                   std::shared_ptr<const std::vector<char>> send_bytes,
+                   send_priority priority = send_priority::broadcast)
+    {
+        if (!send_bytes)
+            return false;
+        return m_manager->broadcast(call_id, std::move(send_bytes), priority);
     }
 
     /**
@@ -311,17 +630,235 @@ class server
      * @param call_id The id to call on the clients.
      * @param send_bytes The bytes to send to the clients.
      * @param session_ids The session ids to broadcast this message.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
      */
     template <typename StlContainer>
-    void broadcast(uint32_t call_id,
+    bool broadcast(uint32_t call_id,
                    const std::vector<char> &send_bytes,
-                   const StlContainer &session_ids)
+                   const StlContainer &session_ids,
+                   send_priority priority = send_priority::broadcast)
+    {
+        static_assert(
+            std::is_same<typename StlContainer::value_type, uint64_t>::value,
+            "server::broadcast: Parameter 'session_ids' needs a base type of "
+            "'uint64_t'.");
+        return m_manager->broadcast(
+            call_id, send_bytes, session_ids, priority);
+    }
+
+    /**
+     * Broadcasts data to specific sessions.
+     * The message will be moved & not copied.
+     * [thread-safe]
+     * @param call_id The id to call on the clients.
+     * @param send_bytes The bytes to send to the clients.
+     * @param session_ids The session ids to broadcast this message.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     */
+    template <typename StlContainer>
+    bool broadcast(uint32_t call_id,
+                   std::vector<char> &&send_bytes,
+                   const StlContainer &session_ids,
+                   send_priority priority = send_priority::broadcast)
+    {
+        static_assert(
+            std::is_same<typename StlContainer::value_type, uint64_t>::value,
+            "server::broadcast: Parameter 'session_ids' needs a base type of "
+            "'uint64_t'.");
+        return m_manager->broadcast(
+            call_id, std::move(send_bytes), session_ids, priority);
+    }
+
+    /**
+     * Broadcasts data to specific sessions.
+     * The message is shared & must not be modified afterwards,
+     * so it can be reused for further broadcasts without copying.
+     * [thread-safe]
+     * @param call_id The id to call on the clients.
+     * @param send_bytes The bytes to send to the clients.
+     * @param session_ids The session ids to broadcast this message.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     */
+    template <typename StlContainer>
+    bool broadcast(uint32_t call_id,
+                   std::shared_ptr<const std::vector<char>> send_bytes,
+                   const StlContainer &session_ids,
+                   send_priority priority = send_priority::broadcast)
     {
         static_assert(
             std::is_same<typename StlContainer::value_type, uint64_t>::value,
             "server::broadcast: Parameter 'session_ids' needs a base type of "
             "'uint64_t'.");
-        m_manager->broadcast(call_id, send_bytes, session_ids);
+        if (!send_bytes)
+            return false;
+        return m_manager->broadcast(
+            call_id, std::move(send_bytes), session_ids, priority);
+    }
+
+    /**
+     * Broadcasts data to all sessions with a conflation key.
+     * A still unsent message with the same key & priority is replaced
+     * in the queue of each session, so slow sessions only get the
+     * latest message of a key instead of a backlog.
+     * The message will be copied one time.
+     * [thread-safe]
+     * @param call_id The id to call on the clients.
+     * @param conflation_key The key of the message to replace,
+     * for e.g. the call id.
+     * @param send_bytes The bytes to send to the clients.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     * If 'parallel_broadcast' is set, only the server budget is checked,
+     * since the sessions are reached later on the workers.
+     */
+    bool broadcast_conflated(uint32_t call_id,
+                             uint64_t conflation_key,
+                             const std::vector<char> &send_bytes,
+                             send_priority priority = send_priority::broadcast)
+    {
+        return m_manager->broadcast_conflated(
+            call_id, conflation_key, send_bytes, priority);
+    }
+
+    /**
+     * Broadcasts data to all sessions with a conflation key.
+     * The message will be moved & not copied.
+     * [thread-safe]
+     * @param call_id The id to call on the clients.
+     * @param conflation_key The key of the message to replace.
+     * @param send_bytes The bytes to send to the clients.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     * If 'parallel_broadcast' is set, only the server budget is checked,
+     * since the sessions are reached later on the workers.
+     */
+    bool broadcast_conflated(uint32_t call_id,
+                             uint64_t conflation_key,
+                             std::vector<char> &&send_bytes,
+                             send_priority priority = send_priority::broadcast)
+    {
+        return m_manager->broadcast_conflated(
+            call_id, conflation_key, std::move(send_bytes), priority);
+    }
+
+    /**
+     * Broadcasts data to all sessions with a conflation key.
+     * The message is shared & must not be modified afterwards.
+     * [thread-safe]
+     * @param call_id The id to call on the clients.
+     * @param conflation_key The key of the message to replace.
+     * @param send_bytes The bytes to send to the clients.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     * If 'parallel_broadcast' is set, only the server budget is checked,
+     * since the sessions are reached later on the workers.
+     */
+    bool
+    broadcast_conflated(uint32_t call_id,
+                        uint64_t conflation_key,
+                        std::shared_ptr<const std::vector<char>> send_bytes,
+                        send_priority priority = send_priority::broadcast)
+    {
+        if (!send_bytes)
+            return false;
+        return m_manager->broadcast_conflated(
+            call_id, conflation_key, std::move(send_bytes), priority);
+    }
+
+    /**
+     * Publishes data to the subscribers of a topic.
+     * The message will be copied one time.
+     * [thread-safe]
+     * @param topic The topic to publish to.
+     * @param call_id The id to call on the clients.
+     * @param send_bytes The bytes to send to the clients.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     */
+    bool publish(const std::string &topic,
+                 uint32_t call_id,
+                 const std::vector<char> &send_bytes,
+                 send_priority priority = send_priority::broadcast)
+    {
+        return m_manager->publish(topic, call_id, send_bytes, priority);
+    }
+
+    /**
+     * Publishes data to the subscribers of a topic.
+     * The message will be moved & not copied.
+     * [thread-safe]
+     * @param topic The topic to publish to.
+     * @param call_id The id to call on the clients.
+     * @param send_bytes The bytes to send to the clients.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     */
+    bool publish(const std::string &topic,
+                 uint32_t call_id,
+                 std::vector<char> &&send_bytes,
+                 send_priority priority = send_priority::broadcast)
+    {
+        return m_manager->publish(
+            topic, call_id, std::move(send_bytes), priority);
+    }
+
+    /**
+     * Publishes data to the subscribers of a topic.
+     * The message is shared & must not be modified afterwards.
+     * [thread-safe]
+     * @param topic The topic to publish to.
+     * @param call_id The id to call on the clients.
+     * @param send_bytes The bytes to send to the clients.
+     * @param priority The priority to queue the message with.
+     * @return True if queued, false if a budget was exceeded.
+     */
+    bool publish(const std::string &topic,
+                 uint32_t call_id,
+                 std::shared_ptr<const std::vector<char>> send_bytes,
+                 send_priority priority = send_priority::broadcast)
+    {
+        if (!send_bytes)
+            return false;
+        return m_manager->publish(
+            topic, call_id, std::move(send_bytes), priority);
+    }
+
+    /**
+     * Subscribes a session to a topic.
+     * [thread-safe]
+     * @param session_id The id of the session.
+     * @param topic The topic to subscribe to.
+     * @return True if subscribed, false if the session was not found.
+     */
+    bool subscribe(uint64_t session_id, const std::string &topic)
+    {
+        return m_manager->subscribe(session_id, topic);
+    }
+
+    /**
+     * Unsubscribes a session from a topic.
+     * [thread-safe]
+     * @param session_id The id of the session.
+     * @param topic The topic to unsubscribe from.
+     * @return True if unsubscribed, false if it was not subscribed.
+     */
+    bool unsubscribe(uint64_t session_id, const std::string &topic)
+    {
+        return m_manager->unsubscribe(session_id, topic);
+    }
+
+    /**
+     * Returns the amount of subscribers of a topic.
+     * [thread-safe]
+     * @param topic The topic to look up.
+     * @return The amount of subscribers.
+     */
+    std::size_t subscribers(const std::string &topic)
+    {
+        return m_manager->subscribers(topic);
     }
 
     /**
@@ -352,6 +889,25 @@ class server
      * @return True if successfully bound the handler, false if not.
      */
     bool bind(uint32_t bind_id, std::function<void(session_context *)> handler)
+    {
+        return bind(bind_id, std::move(handler), call_policy());
+    }
+
+    /**
+     * Binds a handler specified by an id
+     * which the client may call with its call_id.
+     * The policy limits the concurrent executions of this handler,
+     * so expensive handlers can't starve the others.
+     * Rejected requests are answered with an empty response.
+     * [thread-safe]
+     * @param bind_id The id to listen on.
+     * @param handler The handler to call if a request was received.
+     * @param policy The execution policy of the handler.
+     * @return True if successfully bound the handler, false if not.
+     */
+    bool bind(uint32_t bind_id,
+              std::function<void(session_context *)> handler,
+              const call_policy &policy)
     {
         std::unique_lock<std::mutex> lock(m_mtx);
         if (m_running || m_manager->connections() != 0)
@@ -361,10 +917,77 @@ class server
             RADRPC_THROW("server::bind: The given id '" +
                          std::to_string(bind_id) +
                          "' was already bound to a function.");
-        m_manager->bound_funcs[bind_id] = std::move(handler);
+        auto &func = m_manager->bound_funcs[bind_id];
+        func.handler = std::move(handler);
+        if (policy.max_concurrent != 0)
+            func.limit = std::make_shared<impl::server::bulkhead>(policy);
         return true;
     }
 
+    /**
+     * Returns the execution statistics of a bound handler.
+     * The statistics are only tracked for handlers bound with a
+     * limiting 'call_policy', otherwise all values are zero.
+     * [thread-safe]
+     * @param bind_id The id of the bound handler.
+     * @return The statistics of the handler.
+     */
+    call_stats get_call_stats(uint32_t bind_id)
+    {
+        auto func_itr = m_manager->bound_funcs.find(bind_id);
+        if (func_itr == m_manager->bound_funcs.end() ||
+            !func_itr->second.limit)
+            return call_stats{};
+        return func_itr->second.limit->stats();
+    }
+
+    /**
+     * Returns the statistics of the load shedding.
+     * Requests are only measured if 'server_config::admission_target'
+     * is set, otherwise all values are zero.
+     * [thread-safe]
+     * @return The statistics of the load shedding.
+     */
+    admission_stats get_admission_stats()
+    {
+        return m_manager->admission.stats();
+    }
+
+    /**
+     * Replaces the addresses allowed to connect, which applies to the
+     * next accepted connections. The open connections are kept &
+     * still count to 'ip_policy::max_connections'.
+     * [thread-safe]
+     * @param policy The policy to apply.
+     * @return True if applied, false if a range is invalid.
+     */
+    bool set_ip_policy(const ip_policy &policy)
+    {
+        return m_manager->ip_filter->set(policy);
+    }
+
+    /**
+     * Returns the statistics of the pool keeping the receive
+     * buffers released by hibernating sessions.
+     * [thread-safe]
+     * @return The statistics of the buffer pool.
+     */
+    buffer_pool_stats get_buffer_pool_stats()
+    {
+        return m_manager->buffers->stats();
+    }
+
+    /**
+     * Returns the requests which exceeded the rate
+     * limits of their sessions, by the action taken.
+     * [thread-safe]
+     * @return The statistics of the rate limits.
+     */
+    rate_limit_stats get_rate_limit_stats()
+    {
+        return m_manager->get_rate_limit_stats();
+    }
+
     /**
      * Binds a handler that will fire
      * on each incoming session creation request.
@@ -382,6 +1005,53 @@ class server
         return true;
     }
 
+    /**
+     * Binds a handler that will fire if a client
+     * wants to subscribe to a topic with 'client::subscribe()'.
+     * The handler decides whether the session may subscribe,
+     * unsubscribing is always allowed.
+     * [thread-safe]
+     * @param handler The handler to call on each subscribe request.
+     * @return True if bound successfully, false if not
+     */
+    bool bind_subscribe(
+        std::function<bool(session_context *, const std::string &)> handler)
+    {
+        auto subscribed = bind(
+            config::subscribe_call_id,
+            [handler{std::move(handler)}](session_context *ctx) {
+                std::string topic(ctx->data(), ctx->size());
+                bool accepted =
+                    (!handler || handler(ctx, topic)) && ctx->subscribe(topic);
+                ctx->response = {static_cast<char>(accepted)};
+            });
+        if (!subscribed)
+            return false;
+        return bind(config::unsubscribe_call_id, [](session_context *ctx) {
+            ctx->response = {static_cast<char>(
+                ctx->unsubscribe(std::string(ctx->data(), ctx->size())))};
+        });
+    }
+
+    /**
+     * Binds a handler that will fire when a session starts to exceed
+     * 'session_config::max_pending_bytes' or 'max_pending_age',
+     * before the configured 'slow_consumer_action' is taken.
+     * [thread-safe]
+     * @param handler The handler to call if a session is slow.
+     * @return True if bound successfully, false if not
+     */
+    bool bind_slow_consumer(
+        std::function<void(const session_info &, const write_progress &)>
+            handler)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (m_running || m_manager->connections() != 0)
+            return false;
+        m_manager->on_slow_consumer = std::move(handler);
+        return true;
+    }
+
     /**
      * Binds a handler that will fire when the session was created.
      * The handler allows to configure & inspect the
@@ -26,6 +26,8 @@
 #define RADRPC_TYPES_HPP
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/beast/core/flat_buffer.hpp>
@@ -79,6 +81,32 @@ struct server_streams
 #endif
 };
 
+enum class placement_mode : unsigned char
+{
+    none,      ///< The threads are placed by the operating system.
+    cpus,      ///< Each thread is pinned to the next cpu of the cpu list.
+    compact,   ///< Each thread is pinned to the next cpu, filling up a numa
+               ///< node before using the next.
+    scatter,   ///< Each thread is pinned to a cpu of the next numa node.
+    numa_node, ///< The threads may run on all cpus of one numa node.
+};
+
+/**
+ * The policy to place IO threads on cpus.
+ * Since the buffers are allocated by the threads using them,
+ * pinned threads also keep their memory on the local numa node.
+ */
+class thread_placement
+{
+  public:
+    placement_mode mode;            ///< How to place the threads.
+    std::vector<unsigned int> cpus; ///< The cpus for 'placement_mode::cpus'.
+    unsigned int node; ///< The numa node for 'placement_mode::numa_node',
+                       ///< the threads aren't placed if it has no cpus.
+
+    thread_placement() : mode(placement_mode::none), node(0) {}
+};
+
 class client_config
 {
   public:
@@ -87,13 +115,19 @@ class client_config
     std::size_t max_read_bytes;  ///< Maximum message size to receive.
     unsigned int send_attempts;  ///< The amount of attempts to send a message.
     duration send_attempt_delay; ///< The delay after a failed attempt.
+    thread_placement placement;  ///< The placement of the IO thread.
+    duration spin_budget; ///< The time the IO thread polls before blocking.
+    duration socket_busy_poll; ///< The SO_BUSY_POLL time, zero to disable.
 
     client_config() :
         host_address(""),
         port(0),
         max_read_bytes(0),
         send_attempts(0),
-        send_attempt_delay({})
+        send_attempt_delay({}),
+        placement(),
+        spin_budget(duration::zero()),
+        socket_busy_poll(duration::zero())
     {
     }
 };
@@ -136,6 +170,40 @@ inline bool operator&(server_mode lhs, server_mode rhs)
         static_cast<std::underlying_type<server_mode>::type>(rhs));
 }
 
+enum class server_io_mode : unsigned char
+{
+    shared,     ///< All workers run one io context.
+    per_worker, ///< Each worker runs its own io context.
+};
+
+/**
+ * The addresses allowed to connect, checked before a session is created.
+ * The most specific range of 'allow' & 'deny' decides, addresses in
+ * none of them are only accepted if 'allow' is empty.
+ * Ranges are written like "10.0.0.0/8", "2001:db8::/32" or "127.0.0.1".
+ */
+class ip_policy
+{
+  public:
+    std::vector<std::string> allow; ///< The ranges to accept.
+    std::vector<std::string> deny;  ///< The ranges to reject.
+    unsigned int max_connections; ///< The connections per address,
+                                  ///< zero for unlimited.
+    double accepts_per_sec; ///< The accepted connections per second of an
+                            ///< address, zero for unlimited.
+    double accept_burst; ///< The connections an address may open at once,
+                         ///< zero for one second of the rate.
+
+    ip_policy() :
+        allow(),
+        deny(),
+        max_connections(0),
+        accepts_per_sec(0),
+        accept_burst(0)
+    {
+    }
+};
+
 class server_config
 {
   public:
@@ -146,6 +214,34 @@ class server_config
     std::size_t
         max_handshake_bytes; ///< The maximum handshake size for clients.
     server_mode mode; ///< The mode represented as flag to run the server.
+    server_io_mode io_mode; ///< How the workers run the io contexts.
+    bool reuse_port; ///< Opens an acceptor per worker with SO_REUSEPORT.
+    unsigned int
+        pending_accepts; ///< The amount of outstanding accepts per acceptor.
+    thread_placement placement; ///< The placement of the workers.
+    duration spin_budget; ///< The time a worker polls before blocking.
+    duration socket_busy_poll; ///< The SO_BUSY_POLL time of the sessions,
+                               ///< zero to disable.
+    bool parallel_broadcast; ///< Fans out broadcasts to all sessions on the
+                             ///< workers, which may reorder them with the
+                             ///< targeted broadcasts & publishes.
+    std::size_t max_queued_bytes; ///< The bytes of all broadcasts waiting
+                                  ///< to be sent, zero for unlimited.
+    duration admission_target; ///< The acceptable time from receiving to
+                               ///< dispatching a request, zero to admit all.
+    duration admission_interval; ///< The interval the dispatch times must
+                                 ///< stay above the target to shed requests.
+    unsigned int fair_concurrency; ///< The concurrent executions scheduled
+                                   ///< fairly among the tenants, zero to
+                                   ///< execute in arrival order.
+    ip_policy ip_filter; ///< The addresses allowed to connect.
+    duration timer_resolution; ///< The tick of the timer wheel driving the
+                               ///< pings, which may delay them by a tick.
+    bool compact; ///< Releases the handshakes after accepting & the buffers
+                  ///< & queues of idle sessions, at the cost of
+                  ///< reallocating them for the next message.
+    std::size_t buffer_pool_bytes; ///< The bytes of released receive buffers
+                                   ///< kept for reuse, zero to free them.
 
     server_config() :
         host_address(""),
@@ -153,7 +249,22 @@ class server_config
         workers(0),
         max_sessions(0),
         max_handshake_bytes(0),
-        mode(server_mode::plain)
+        mode(server_mode::plain),
+        io_mode(server_io_mode::shared),
+        reuse_port(false),
+        pending_accepts(1),
+        placement(),
+        spin_budget(duration::zero()),
+        socket_busy_poll(duration::zero()),
+        parallel_broadcast(false),
+        max_queued_bytes(0),
+        admission_target(duration::zero()),
+        admission_interval(std::chrono::milliseconds(100)),
+        fair_concurrency(0),
+        ip_filter(),
+        timer_resolution(std::chrono::milliseconds(10)),
+        compact(false),
+        buffer_pool_bytes(16 * 1024 * 1024)
     {
     }
 };
@@ -167,14 +278,176 @@ class server_timeout
     explicit server_timeout() : handshake_or_close_timeout(duration::max()) {}
 };
 
+/**
+ * The action to take if a session doesn't keep up with its writes.
+ */
+enum class slow_consumer_action : unsigned char
+{
+    warn,  ///< Only call the slow consumer handler.
+    drop,  ///< Drop the queued & new broadcasts until the session caught up.
+    close, ///< Close the session, which also cancels the stalled write.
+};
+
+/**
+ * The action to take if a request exceeds the rate limit of a session.
+ */
+enum class rate_limit_action : unsigned char
+{
+    delay,  ///< Delay the request & the reading until it is in the limit.
+    reject, ///< Reject the request, the client receives an empty response.
+    close,  ///< Close the session.
+};
+
+/**
+ * The rates of a token bucket limiter.
+ */
+class rate_limit
+{
+  public:
+    double requests_per_sec; ///< The sustained requests, zero for unlimited.
+    double request_burst;    ///< The requests allowed at once,
+                             ///< zero for one second of the rate.
+    double bytes_per_sec;    ///< The sustained bytes, zero for unlimited.
+    double byte_burst;       ///< The bytes allowed at once,
+                             ///< zero for one second of the rate.
+
+    rate_limit() :
+        requests_per_sec(0),
+        request_burst(0),
+        bytes_per_sec(0),
+        byte_burst(0)
+    {
+    }
+};
+
 class session_config
 {
   public:
     std::size_t
         max_transfer_bytes; ///< Maximum message size of each received message.
     duration ping_delay;    ///< The delay to ping the client to check activity.
+    std::size_t max_pending_bytes; ///< The unsent bytes to consider the
+                                   ///< session as slow, zero to disable.
+    duration max_pending_age; ///< The age of the oldest unsent message to
+                              ///< consider the session as slow, zero to
+                              ///< disable.
+    slow_consumer_action
+        slow_consumer; ///< The action to take if the session is slow.
+    std::size_t max_queued_bytes; ///< The bytes waiting to be sent to the
+                                  ///< session, zero for unlimited.
+    std::size_t read_pause_bytes; ///< The queued bytes to pause reading
+                                  ///< requests, zero to always read.
+    std::size_t read_resume_bytes; ///< The queued bytes to resume reading,
+                                   ///< at most 'read_pause_bytes'.
+    std::string tenant;  ///< The tenant to schedule the requests with,
+                         ///< empty to schedule the session on its own.
+    unsigned int weight; ///< The share of the tenant's executions, if the
+                         ///< sessions of a tenant differ, the weight of the
+                         ///< session queuing first at the tenant is used.
+    rate_limit limit; ///< The rate limit of the requests.
+    std::unordered_map<uint32_t, rate_limit>
+        call_limits; ///< The rate limits replacing 'limit' for a call id.
+    rate_limit_action
+        rate_limited; ///< The action if a request exceeds the rate limit.
+    bool keep_handshake; ///< Keeps the handshakes for the handlers if the
+                         ///< server is compact.
+    std::size_t hibernate_bytes; ///< The receive buffer to keep between
+                                 ///< requests, a larger one is released to
+                                 ///< the buffer pool, zero to keep all.
+
+    session_config() :
+        max_transfer_bytes(0),
+        ping_delay(duration::zero()),
+        max_pending_bytes(0),
+        max_pending_age(duration::zero()),
+        slow_consumer(slow_consumer_action::warn),
+        max_queued_bytes(0),
+        read_pause_bytes(0),
+        read_resume_bytes(0),
+        tenant(),
+        weight(1),
+        limit(),
+        call_limits(),
+        rate_limited(rate_limit_action::delay),
+        keep_handshake(false),
+        hibernate_bytes(0)
+    {
+    }
+};
+
+/**
+ * The priority classes of the messages sent to the clients.
+ * Queued messages with a higher priority are written first.
+ */
+enum class send_priority : unsigned char
+{
+    control,   ///< Status messages, written before all others.
+    response,  ///< Responses of the bound handlers.
+    broadcast, ///< Broadcasts to the sessions.
+};
+
+/**
+ * The action to take if a bound handler has no free execution slot.
+ */
+enum class overflow_action
+{
+    reject, ///< Reject the request with an error frame.
+    queue,  ///< Queue the request until an execution slot is free.
+};
 
-    session_config() : max_transfer_bytes(0), ping_delay(duration::zero()) {}
+class call_policy
+{
+  public:
+    unsigned int max_concurrent; ///< Maximum concurrent executions of the
+                                 ///< handler, zero for unlimited.
+    std::size_t max_queued;   ///< Maximum requests waiting for a free slot.
+    overflow_action overflow; ///< The action if no slot is free.
+
+    call_policy() :
+        max_concurrent(0),
+        max_queued(0),
+        overflow(overflow_action::reject)
+    {
+    }
+};
+
+struct call_stats
+{
+    unsigned int executing; ///< The current executions of the handler.
+    std::size_t queued;     ///< The requests waiting for a free slot.
+    uint64_t executed;      ///< The total executions of the handler.
+    uint64_t rejected;      ///< The total rejected requests.
+};
+
+struct rate_limit_stats
+{
+    uint64_t delayed;  ///< The total delayed requests.
+    uint64_t rejected; ///< The total rejected requests.
+    uint64_t closed;   ///< The total sessions closed by the rate limit.
+};
+
+struct buffer_pool_stats
+{
+    std::size_t pooled_bytes; ///< The bytes of released buffers kept.
+    uint64_t hits;   ///< The allocations served by a released buffer.
+    uint64_t misses; ///< The allocations which allocated a new buffer.
+};
+
+struct admission_stats
+{
+    bool overloaded;   ///< Whether the server currently sheds requests.
+    uint64_t admitted; ///< The total dispatched requests.
+    uint64_t shed;     ///< The total requests rejected as overloaded.
+};
+
+/**
+ * The write progress of a session.
+ */
+struct write_progress
+{
+    std::size_t pending_bytes;    ///< The queued & currently written bytes.
+    std::size_t pending_messages; ///< The queued & currently written messages.
+    duration oldest_age;          ///< The age of the oldest unsent message.
 };
 
 struct session_info
@@ -187,10 +460,23 @@ struct session_info
     session_config &config;  ///< The used configuration for this session.
 };
 
+/**
+ * The status of a response to 'client::send_recv()'.
+ */
+enum class response_status : unsigned char
+{
+    ok,          ///< The request was processed.
+    rejected,    ///< The request was rejected by the server.
+    overloaded,  ///< The request was shed, the client should back off.
+    no_response, ///< No response was received, for e.g. on a timeout.
+};
+
 class receive_buffer : public boost::beast::flat_buffer
 {
   public:
-    receive_buffer() = default;
+    response_status status; ///< The status of the response.
+
+    receive_buffer() : status(response_status::ok) {}
 
     boost::beast::flat_buffer &base()
     {
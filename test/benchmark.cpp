@@ -0,0 +1,873 @@
+/*
+ * MIT License
+
+ * Copyright (c) 2020 reapler
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+   all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "radrpc.hpp"
+
+using namespace radrpc;
+
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+const char *bench_backend = "io_uring";
+#else
+const char *bench_backend = "epoll";
+#endif
+
+
+
+
+enum BenchRpcCommands
+{
+    BENCH_RPC_ECHO,
+};
+
+struct bench_options
+{
+    std::vector<unsigned int> workers; ///< The worker counts to benchmark.
+    unsigned int clients;              ///< The amount of concurrent clients.
+    unsigned int pending_accepts;      ///< The outstanding accepts to use.
+    unsigned int seconds;              ///< The duration of each run.
+    std::size_t bytes;                 ///< The request size.
+    uint16_t port;                     ///< The port to use.
+    duration spin_budget;              ///< The spin budget for busy polling.
+    std::vector<unsigned int> sessions; ///< The session counts to fan out to.
+    unsigned int broadcasts;            ///< The broadcasts per fan-out run.
+};
+
+server_config bench_server_config(const bench_options &opt,
+                                  unsigned int workers,
+                                  server_io_mode io_mode)
+{
+    server_config cfg;
+    cfg.host_address = "127.0.0.1";
+    cfg.port = opt.port;
+    cfg.workers = workers;
+    cfg.max_sessions = 100000;
+    cfg.max_handshake_bytes = 1024 * 200;
+    cfg.mode = server_mode::plain;
+    cfg.io_mode = io_mode;
+    return cfg;
+}
+
+server_timeout bench_server_timeout()
+{
+    server_timeout cfg;
+    cfg.handshake_or_close_timeout = std::chrono::seconds(5);
+    return cfg;
+}
+
+session_config bench_session_config()
+{
+    session_config cfg;
+    cfg.max_transfer_bytes = 1024 * 1024;
+    cfg.ping_delay = std::chrono::seconds(30);
+    return cfg;
+}
+
+client_config bench_client_config(const bench_options &opt)
+{
+    client_config cfg;
+    cfg.host_address = "127.0.0.1";
+    cfg.port = opt.port;
+    cfg.max_read_bytes = 0xFFFFFFFF;
+    cfg.send_attempts = 0;
+    cfg.send_attempt_delay = duration::zero();
+    return cfg;
+}
+
+client_timeout bench_client_timeout()
+{
+    client_timeout cfg;
+    cfg.handshake_timeout = std::chrono::seconds(5);
+    cfg.send_timeout = std::chrono::seconds(5);
+    cfg.response_timeout = std::chrono::seconds(5);
+    return cfg;
+}
+
+std::unique_ptr<server> bench_create_server(const server_config &cfg)
+{
+    auto srv = std::unique_ptr<server>(
+        new server(cfg, bench_server_timeout(), bench_session_config()));
+    srv->bind(BENCH_RPC_ECHO, [](session_context *ctx) {
+        ctx->response.assign(ctx->data(), ctx->data() + ctx->size());
+    });
+    return srv;
+}
+
+
+
+
+/**
+ * Raw websocket sessions on one io context, which only
+ * count the received messages to keep the client side cheap.
+ */
+class fanout_clients
+{
+    struct session
+    {
+        websocket::stream<tcp::socket> ws;
+        boost::beast::flat_buffer buffer;
+
+        explicit session(boost::asio::io_context &io_ctx) : ws(io_ctx) {}
+    };
+
+    boost::asio::io_context m_io_ctx;
+    std::vector<std::unique_ptr<session>> m_sessions;
+    std::thread m_thread;
+
+    void read(session &s)
+    {
+        s.ws.async_read(s.buffer,
+                        [this, &s](boost::system::error_code ec, std::size_t) {
+                            if (ec)
+                                return;
+                            s.buffer.consume(s.buffer.size());
+                            received++;
+                            read(s);
+                        });
+    }
+
+  public:
+    std::atomic<uint64_t> received;
+
+    fanout_clients() : received(0) {}
+
+    ~fanout_clients()
+    {
+        m_io_ctx.stop();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    /**
+     * Connects the sessions one after another & starts reading.
+     * @return The amount of connected sessions.
+     */
+    std::size_t connect(const bench_options &opt, std::size_t count)
+    {
+        tcp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"),
+                               opt.port);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto s = std::unique_ptr<session>(new session(m_io_ctx));
+            boost::system::error_code ec;
+            s->ws.next_layer().connect(endpoint, ec);
+            if (!ec)
+                s->ws.handshake("127.0.0.1", "/", ec);
+            if (ec)
+            {
+                printf("  connected %zu of %zu sessions: %s\n",
+                       i,
+                       count,
+                       ec.message().c_str());
+                break;
+            }
+            s->ws.binary(true);
+            m_sessions.push_back(std::move(s));
+        }
+        for (auto &s : m_sessions)
+            read(*s);
+        m_thread = std::thread([this] { m_io_ctx.run(); });
+        return m_sessions.size();
+    }
+};
+
+/**
+ * Runs the clients, each sending echo requests
+ * as fast as possible on its own thread.
+ * @return The requests per second of all clients.
+ */
+double run_echo_load(const bench_options &opt)
+{
+    std::atomic<bool> run = ATOMIC_VAR_INIT(true);
+    std::atomic<uint64_t> requests = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> failed = ATOMIC_VAR_INIT(0);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < opt.clients; ++i)
+    {
+        threads.emplace_back([&] {
+            client<client_mode::plain> cl(bench_client_config(opt),
+                                          bench_client_timeout());
+            if (!cl.connect())
+            {
+                failed++;
+                return;
+            }
+            std::vector<char> msg(opt.bytes, 0x1);
+            uint64_t done = 0;
+            while (run)
+            {
+                if (cl.send_recv(BENCH_RPC_ECHO, msg).empty())
+                    failed++;
+                else
+                    done++;
+            }
+            requests += done;
+        });
+    }
+    auto begin = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    run = false;
+    for (auto &thread : threads)
+        thread.join();
+    auto elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - begin)
+                       .count();
+    if (failed)
+        printf("  %llu requests failed\n", (unsigned long long)failed.load());
+    return requests / elapsed;
+}
+
+/**
+ * Runs the clients, each sending echo requests
+ * one after another & measuring the round trips.
+ * @return The sorted round trips in microseconds of all clients.
+ */
+std::vector<double> run_latency_load(const bench_options &opt,
+                                     const client_config &cfg)
+{
+    std::atomic<bool> run = ATOMIC_VAR_INIT(true);
+    std::mutex samples_mtx;
+    std::vector<double> samples;
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < opt.clients; ++i)
+    {
+        threads.emplace_back([&] {
+            client<client_mode::plain> cl(cfg, bench_client_timeout());
+            if (!cl.connect())
+                return;
+            std::vector<char> msg(opt.bytes, 0x1);
+            std::vector<double> round_trips;
+            while (run)
+            {
+                auto begin = std::chrono::steady_clock::now();
+                if (cl.send_recv(BENCH_RPC_ECHO, msg).empty())
+                    continue;
+                round_trips.push_back(
+                    std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - begin)
+                        .count());
+            }
+            std::unique_lock<std::mutex> lock(samples_mtx);
+            samples.insert(samples.end(), round_trips.begin(), round_trips.end());
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    run = false;
+    for (auto &thread : threads)
+        thread.join();
+    std::sort(samples.begin(), samples.end());
+    return samples;
+}
+
+/**
+ * Returns the percentile of sorted samples.
+ */
+double percentile(const std::vector<double> &samples, double p)
+{
+    if (samples.empty())
+        return 0;
+    auto index = static_cast<std::size_t>(p / 100 * (samples.size() - 1));
+    return samples[index];
+}
+
+/**
+ * Runs the clients, each connecting & disconnecting
+ * as fast as possible on its own thread.
+ * @return The established connections per second of all clients.
+ */
+double run_connect_load(const bench_options &opt)
+{
+    std::atomic<bool> run = ATOMIC_VAR_INIT(true);
+    std::atomic<uint64_t> connects = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> failed = ATOMIC_VAR_INIT(0);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < opt.clients; ++i)
+    {
+        threads.emplace_back([&] {
+            client<client_mode::plain> cl(bench_client_config(opt),
+                                          bench_client_timeout());
+            uint64_t done = 0;
+            while (run)
+            {
+                if (cl.connect())
+                    done++;
+                else
+                    failed++;
+                cl.disconnect();
+            }
+            connects += done;
+        });
+    }
+    auto begin = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    run = false;
+    for (auto &thread : threads)
+        thread.join();
+    auto elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - begin)
+                       .count();
+    if (failed)
+        printf("  %llu connects failed\n", (unsigned long long)failed.load());
+    return connects / elapsed;
+}
+
+/**
+ * Compares a single acceptor against an acceptor per worker.
+ */
+void bench_accept(const bench_options &opt)
+{
+    printf("%-12s %8s %8s %14s\n",
+           "acceptors",
+           "workers",
+           "pending",
+           "connects/s");
+    for (auto workers : opt.workers)
+    {
+        for (auto reuse_port : {false, true})
+        {
+            auto cfg =
+                bench_server_config(opt, workers, server_io_mode::shared);
+            cfg.reuse_port = reuse_port;
+            cfg.pending_accepts = reuse_port ? opt.pending_accepts : 1;
+            auto srv = bench_create_server(cfg);
+            srv->async_start();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            auto rate = run_connect_load(opt);
+            srv->stop();
+            printf("%-12s %8u %8u %14.0f\n",
+                   reuse_port ? "reuse_port" : "single",
+                   workers,
+                   cfg.pending_accepts,
+                   rate);
+        }
+    }
+}
+
+/**
+ * Compares unpinned workers against pinned workers.
+ */
+void bench_placement(const bench_options &opt)
+{
+    printf("%-12s %8s %14s\n", "placement", "workers", "requests/s");
+    for (auto workers : opt.workers)
+    {
+        for (auto mode : {placement_mode::none,
+                          placement_mode::compact,
+                          placement_mode::scatter})
+        {
+            auto cfg =
+                bench_server_config(opt, workers, server_io_mode::per_worker);
+            cfg.placement.mode = mode;
+            auto srv = bench_create_server(cfg);
+            srv->async_start();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            auto rate = run_echo_load(opt);
+            srv->stop();
+            printf("%-12s %8u %14.0f\n",
+                   mode == placement_mode::none
+                       ? "none"
+                       : mode == placement_mode::compact ? "compact"
+                                                         : "scatter",
+                   workers,
+                   rate);
+        }
+    }
+}
+
+/**
+ * Compares the round trips of blocking & busy polling workers.
+ */
+void bench_latency(const bench_options &opt)
+{
+    printf("%-14s %8s %10s %10s %10s\n",
+           "mode",
+           "workers",
+           "p50 us",
+           "p99 us",
+           "p99.9 us");
+    for (auto workers : opt.workers)
+    {
+        for (auto mode : {"blocking", "spin_server", "spin_both", "busy_poll"})
+        {
+            std::string name = mode;
+            auto cfg =
+                bench_server_config(opt, workers, server_io_mode::shared);
+            auto cl_cfg = bench_client_config(opt);
+            if (name != "blocking")
+                cfg.spin_budget = opt.spin_budget;
+            if (name == "spin_both" || name == "busy_poll")
+                cl_cfg.spin_budget = opt.spin_budget;
+            if (name == "busy_poll")
+            {
+                cfg.socket_busy_poll = opt.spin_budget;
+                cl_cfg.socket_busy_poll = opt.spin_budget;
+            }
+            auto srv = bench_create_server(cfg);
+            srv->async_start();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            auto samples = run_latency_load(opt, cl_cfg);
+            srv->stop();
+            printf("%-14s %8u %10.1f %10.1f %10.1f\n",
+                   mode,
+                   workers,
+                   percentile(samples, 50),
+                   percentile(samples, 99),
+                   percentile(samples, 99.9));
+        }
+    }
+}
+
+/**
+ * Compares broadcasts copying the body against a shared body.
+ */
+void bench_fanout(const bench_options &opt)
+{
+    // Each session needs a descriptor on both sides.
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    printf("%-8s %9s %14s %12s\n", "body", "sessions", "broadcasts/s", "MB/s");
+    for (auto sessions : opt.sessions)
+    {
+        auto srv = bench_create_server(bench_server_config(
+            opt, opt.workers.front(), server_io_mode::shared));
+        srv->async_start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        fanout_clients clients;
+        auto connected = clients.connect(opt, sessions);
+        for (int i = 0; i < 100 && srv->connections() < (long)connected; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::vector<char> msg(opt.bytes, 0x1);
+        auto shared_msg = std::make_shared<const std::vector<char>>(msg);
+        for (auto shared : {false, true})
+        {
+            clients.received = 0;
+            auto expected = uint64_t(opt.broadcasts) * connected;
+            auto begin = std::chrono::steady_clock::now();
+            for (unsigned int i = 0; i < opt.broadcasts; ++i)
+            {
+                if (shared)
+                    srv->broadcast(BENCH_RPC_ECHO, shared_msg);
+                else
+                    srv->broadcast(BENCH_RPC_ECHO, msg);
+            }
+            auto deadline = begin + std::chrono::seconds(60);
+            while (clients.received < expected &&
+                   std::chrono::steady_clock::now() < deadline)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            auto elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - begin)
+                               .count();
+            if (clients.received < expected)
+                printf("  %llu messages lost\n",
+                       (unsigned long long)(expected - clients.received));
+            printf("%-8s %9zu %14.0f %12.1f\n",
+                   shared ? "shared" : "copy",
+                   connected,
+                   opt.broadcasts / elapsed,
+                   clients.received * (opt.bytes + sizeof(detail::io_header)) /
+                       elapsed / (1024 * 1024));
+        }
+        srv->stop();
+    }
+}
+
+/**
+ * Broadcasts as fast as possible & counts the delivered messages.
+ */
+void bench_broadcast_rate(const bench_options &opt)
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    printf("%8s %9s %14s %14s\n",
+           "workers",
+           "sessions",
+           "calls/s",
+           "delivered/s");
+    for (auto workers : opt.workers)
+    {
+        for (auto sessions : opt.sessions)
+        {
+            auto srv = bench_create_server(
+                bench_server_config(opt, workers, server_io_mode::shared));
+            srv->async_start();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            fanout_clients clients;
+            auto connected = clients.connect(opt, sessions);
+            for (int i = 0; i < 100 && srv->connections() < (long)connected;
+                 ++i)
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            auto msg = std::make_shared<const std::vector<char>>(opt.bytes);
+            clients.received = 0;
+            uint64_t broadcasts = 0;
+            auto begin = std::chrono::steady_clock::now();
+            auto end = begin + std::chrono::seconds(opt.seconds);
+            while (std::chrono::steady_clock::now() < end)
+            {
+                srv->broadcast(BENCH_RPC_ECHO, msg);
+                broadcasts++;
+            }
+            auto elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - begin)
+                               .count();
+            auto delivered = clients.received.load();
+            srv->stop();
+            printf("%8u %9zu %14.0f %14.0f\n",
+                   workers,
+                   connected,
+                   broadcasts / elapsed,
+                   delivered / elapsed);
+        }
+    }
+}
+
+/**
+ * Compares the broadcast latency, from the call until the last
+ * session received it, of fanning out on the caller & on the workers.
+ */
+void bench_broadcast_latency(const bench_options &opt)
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    printf("%-8s %8s %9s %10s %10s %10s\n",
+           "fanout",
+           "workers",
+           "sessions",
+           "p50 ms",
+           "p99 ms",
+           "max ms");
+    for (auto sessions : opt.sessions)
+    {
+        for (auto parallel : {false, true})
+        {
+            auto cfg = bench_server_config(
+                opt, opt.workers.front(), server_io_mode::shared);
+            cfg.parallel_broadcast = parallel;
+            auto srv = bench_create_server(cfg);
+            srv->async_start();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            fanout_clients clients;
+            auto connected = clients.connect(opt, sessions);
+            for (int i = 0; i < 100 && srv->connections() < (long)connected;
+                 ++i)
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            auto msg = std::make_shared<const std::vector<char>>(opt.bytes);
+            std::vector<double> samples;
+            for (unsigned int i = 0; i < opt.broadcasts; ++i)
+            {
+                auto expected = clients.received + connected;
+                auto begin = std::chrono::steady_clock::now();
+                auto deadline = begin + std::chrono::seconds(10);
+                srv->broadcast(BENCH_RPC_ECHO, msg);
+                while (clients.received < expected &&
+                       std::chrono::steady_clock::now() < deadline)
+                    std::this_thread::yield();
+                samples.push_back(std::chrono::duration<double, std::milli>(
+                                      std::chrono::steady_clock::now() - begin)
+                                      .count());
+                clients.received = expected;
+            }
+            srv->stop();
+            std::sort(samples.begin(), samples.end());
+            printf("%-8s %8u %9zu %10.2f %10.2f %10.2f\n",
+                   parallel ? "workers" : "caller",
+                   cfg.workers,
+                   connected,
+                   percentile(samples, 50),
+                   percentile(samples, 99),
+                   samples.empty() ? 0 : samples.back());
+        }
+    }
+}
+
+/**
+ * Returns the bytes allocated on the heap by all arenas.
+ */
+std::size_t heap_bytes()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    auto info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+    auto info = mallinfo();
+    return static_cast<unsigned int>(info.uordblks) +
+           static_cast<unsigned int>(info.hblkhd);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Connects raw sessions, sends one echo request on each & keeps
+ * them idle until the parent closes the pipe. Runs in a child
+ * process, so the heap of the parent only holds the server.
+ * @param go The pipe to wait on for connecting & exiting.
+ * @param ready The pipe to report the connected sessions.
+ */
+void run_idle_sessions(const bench_options &opt, int go, int ready)
+{
+    char signal;
+    if (read(go, &signal, 1) != 1)
+        _exit(EXIT_FAILURE);
+    boost::asio::io_context io_ctx;
+    std::vector<std::unique_ptr<websocket::stream<tcp::socket>>> sessions;
+    tcp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"),
+                           opt.port);
+    std::vector<char> msg(sizeof(detail::io_header) + opt.bytes, 0x1);
+    detail::io_header header(BENCH_RPC_ECHO, 1);
+    std::copy(reinterpret_cast<const char *>(&header),
+              reinterpret_cast<const char *>(&header) + sizeof(header),
+              msg.begin());
+    boost::beast::flat_buffer buffer;
+    for (auto i = 0u; i < opt.sessions.front(); ++i)
+    {
+        auto ws = std::unique_ptr<websocket::stream<tcp::socket>>(
+            new websocket::stream<tcp::socket>(io_ctx));
+        boost::system::error_code ec;
+        ws->next_layer().connect(endpoint, ec);
+        if (!ec)
+            ws->handshake("127.0.0.1", "/", ec);
+        if (!ec)
+        {
+            ws->binary(true);
+            ws->write(boost::asio::buffer(msg), ec);
+        }
+        if (!ec)
+            ws->read(buffer, ec);
+        if (ec)
+            break;
+        buffer.consume(buffer.size());
+        sessions.push_back(std::move(ws));
+    }
+    uint64_t connected = sessions.size();
+    if (write(ready, &connected, sizeof(connected)) != sizeof(connected))
+        _exit(EXIT_FAILURE);
+    while (read(go, &signal, 1) > 0)
+        ;
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * Measures the heap of the server per idle session,
+ * with & without the compact mode.
+ */
+void bench_memory(const bench_options &opt)
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    printf("%-8s %9s %14s %14s\n",
+           "compact",
+           "sessions",
+           "heap KB",
+           "bytes/session");
+    for (auto sessions : opt.sessions)
+    {
+        for (auto compact : {false, true})
+        {
+            // Fork before the server starts its threads
+            int go[2];
+            int ready[2];
+            if (pipe(go) != 0 || pipe(ready) != 0)
+                return;
+            auto child = fork();
+            if (child == 0)
+            {
+                close(go[1]);
+                close(ready[0]);
+                auto child_opt = opt;
+                child_opt.sessions = {sessions};
+                run_idle_sessions(child_opt, go[0], ready[1]);
+            }
+            close(go[0]);
+            close(ready[1]);
+            auto cfg = bench_server_config(
+                opt, opt.workers.front(), server_io_mode::shared);
+            cfg.compact = compact;
+            auto srv = bench_create_server(cfg);
+            srv->async_start();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            auto base = heap_bytes();
+            uint64_t connected = 0;
+            if (write(go[1], "g", 1) != 1 ||
+                read(ready[0], &connected, sizeof(connected)) !=
+                    sizeof(connected))
+                connected = 0;
+            for (int i = 0; i < 100 && srv->connections() < (long)connected;
+                 ++i)
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            auto used = static_cast<double>(heap_bytes()) - base;
+            close(go[1]);
+            close(ready[0]);
+            waitpid(child, nullptr, 0);
+            srv->stop();
+            printf("%-8s %9llu %14.0f %14.0f\n",
+                   compact ? "on" : "off",
+                   (unsigned long long)connected,
+                   used / 1024.0,
+                   connected ? used / connected : 0.0);
+        }
+    }
+}
+
+/**
+ * Compares the shared io context against an io context per worker.
+ */
+void bench_io_mode(const bench_options &opt)
+{
+    printf("%-12s %8s %14s\n", "io_mode", "workers", "requests/s");
+    for (auto workers : opt.workers)
+    {
+        for (auto io_mode :
+             {server_io_mode::shared, server_io_mode::per_worker})
+        {
+            auto srv =
+                bench_create_server(bench_server_config(opt, workers, io_mode));
+            srv->async_start();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            auto rate = run_echo_load(opt);
+            srv->stop();
+            printf("%-12s %8u %14.0f\n",
+                   io_mode == server_io_mode::shared ? "shared" : "per_worker",
+                   workers,
+                   rate);
+        }
+    }
+}
+
+
+
+
+std::vector<unsigned int> parse_list(const std::string &arg)
+{
+    std::vector<unsigned int> values;
+    std::stringstream stream(arg);
+    std::string value;
+    while (std::getline(stream, value, ','))
+        values.push_back(std::stoul(value));
+    return values;
+}
+
+int main(int argc, char **argv)
+{
+    std::map<std::string, std::function<void(const bench_options &)>>
+        scenarios = {
+            {"io_mode", bench_io_mode},
+            {"accept", bench_accept},
+            {"placement", bench_placement},
+            {"latency", bench_latency},
+            {"fanout", bench_fanout},
+            {"broadcast_latency", bench_broadcast_latency},
+            {"broadcast_rate", bench_broadcast_rate},
+            {"memory", bench_memory},
+        };
+
+    bench_options opt;
+    opt.workers = {4, 16, 32};
+    opt.clients = 64;
+    opt.pending_accepts = 4;
+    opt.seconds = 5;
+    opt.bytes = 64;
+    opt.port = 3379;
+    opt.spin_budget = std::chrono::microseconds(50);
+    opt.sessions = {1000, 10000, 50000};
+    opt.broadcasts = 100;
+
+    std::string scenario = argc > 1 ? argv[1] : "";
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--workers")
+            opt.workers = parse_list(value);
+        else if (key == "--clients")
+            opt.clients = std::stoul(value);
+        else if (key == "--pending")
+            opt.pending_accepts = std::stoul(value);
+        else if (key == "--seconds")
+            opt.seconds = std::stoul(value);
+        else if (key == "--bytes")
+            opt.bytes = std::stoul(value);
+        else if (key == "--port")
+            opt.port = static_cast<uint16_t>(std::stoul(value));
+        else if (key == "--sessions")
+            opt.sessions = parse_list(value);
+        else if (key == "--broadcasts")
+            opt.broadcasts = std::stoul(value);
+        else if (key == "--spin")
+            opt.spin_budget = std::chrono::microseconds(std::stoul(value));
+    }
+
+    auto scenario_itr = scenarios.find(scenario);
+    if (scenario_itr == scenarios.end())
+    {
+        printf("Usage: %s <scenario> [--workers 4,16,32] [--clients n] "
+               "[--pending n] [--seconds n] [--bytes n] [--port n] "
+               "[--spin us] [--sessions 1000,10000,50000] "
+               "[--broadcasts n]\n",
+               argv[0]);
+        printf("Scenarios:\n");
+        for (const auto &entry : scenarios)
+            printf("  %s\n", entry.first.c_str());
+        return EXIT_FAILURE;
+    }
+    printf("backend: %s\n", bench_backend);
+    scenario_itr->second(opt);
+    return EXIT_SUCCESS;
+}
@@ -61,6 +61,8 @@ struct client_settings
     uint32_t send_attempts;
     uint32_t attempts_delay_ms;
     bool random_send_timeout;
+    uint32_t stall_chance;
+    uint32_t stall_ms;
 };
 inline std::ostream &operator<<(std::ostream &os, const client_settings &obj)
 {
@@ -73,7 +75,9 @@ inline std::ostream &operator<<(std::ostream &os, const client_settings &obj)
        << "restart_chance: " << obj.restart_chance << std::endl
        << "send_attempts: " << obj.send_attempts << std::endl
        << "attempts_delay_ms: " << obj.attempts_delay_ms << std::endl
-       << "random_send_timeout: " << obj.random_send_timeout << std::endl;
+       << "random_send_timeout: " << obj.random_send_timeout << std::endl
+       << "stall_chance: " << obj.stall_chance << std::endl
+       << "stall_ms: " << obj.stall_ms << std::endl;
     return os;
 }
 
@@ -22,6 +22,10 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  */
 
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
 #include <test/defaults/default_config.hpp>
 #include <test/dep/catch.hpp>
 
@@ -346,4 +350,1113 @@ TEST_CASE("receive_buffer wrapper")
                                    bytes.data(),
                                    bytes.size()));
     }
-}
\ No newline at end of file
+}
+TEST_CASE("push_queue implementation")
+{
+    using namespace radrpc::detail;
+    push_queue queue;
+    auto create_push = [](uint32_t call_id, send_priority priority) {
+        return std::make_shared<data_push>(io_header(call_id, 0), priority);
+    };
+
+    SECTION("priority order")
+    {
+        queue.push(create_push(1, send_priority::broadcast));
+        queue.push(create_push(2, send_priority::response));
+        queue.push(create_push(3, send_priority::broadcast));
+        queue.push(create_push(4, send_priority::control));
+        queue.push(create_push(5, send_priority::response));
+        REQUIRE(queue.size() == 5);
+        for (uint32_t call_id : {4, 2, 5, 1, 3})
+            REQUIRE(queue.pop()->header.call_id == call_id);
+        REQUIRE(queue.empty());
+        REQUIRE(queue.pop() == nullptr);
+    }
+
+    SECTION("clear")
+    {
+        queue.push(create_push(1, send_priority::broadcast));
+        queue.push(create_push(2, send_priority::control));
+        queue.clear();
+        REQUIRE(queue.empty());
+        REQUIRE(queue.pop() == nullptr);
+    }
+
+    SECTION("shrink")
+    {
+        queue.push(create_push(1, send_priority::broadcast));
+        // Kept while not empty
+        queue.shrink();
+        REQUIRE(queue.size() == 1);
+        REQUIRE(queue.pop()->header.call_id == 1);
+        queue.shrink();
+        REQUIRE(queue.empty());
+        queue.push(create_push(2, send_priority::control));
+        queue.push(create_push(3, send_priority::broadcast));
+        REQUIRE(queue.pop()->header.call_id == 2);
+        REQUIRE(queue.pop()->header.call_id == 3);
+    }
+
+    SECTION("conflation")
+    {
+        auto create_conflated = [&](uint32_t call_id,
+                                    uint64_t key,
+                                    send_priority priority) {
+            auto push = create_push(call_id, priority);
+            push->conflate = true;
+            push->conflation_key = key;
+            return push;
+        };
+        queue.push(create_conflated(1, 10, send_priority::broadcast));
+        queue.push(create_push(2, send_priority::broadcast));
+        queue.push(create_conflated(3, 20, send_priority::broadcast));
+        REQUIRE_FALSE(queue.replace(create_push(4, send_priority::broadcast)));
+        REQUIRE_FALSE(
+            queue.replace(create_conflated(5, 30, send_priority::broadcast)));
+        REQUIRE_FALSE(
+            queue.replace(create_conflated(6, 10, send_priority::response)));
+        REQUIRE(
+            queue.replace(create_conflated(7, 10, send_priority::broadcast)));
+        REQUIRE(
+            queue.replace(create_conflated(8, 10, send_priority::broadcast)));
+        REQUIRE(queue.size() == 3);
+        REQUIRE(queue.pop()->header.call_id == 8);
+        // Popped data is not replaced anymore
+        REQUIRE_FALSE(
+            queue.replace(create_conflated(9, 10, send_priority::broadcast)));
+        REQUIRE(
+            queue.replace(create_conflated(10, 20, send_priority::broadcast)));
+        REQUIRE(queue.pop()->header.call_id == 2);
+        REQUIRE(queue.pop()->header.call_id == 10);
+        REQUIRE(queue.empty());
+        queue.push(create_conflated(11, 10, send_priority::broadcast));
+        queue.clear();
+        REQUIRE_FALSE(
+            queue.replace(create_conflated(12, 10, send_priority::broadcast)));
+    }
+
+    SECTION("pending bytes & age")
+    {
+        auto header_size = sizeof(io_header);
+        auto before = std::chrono::steady_clock::now();
+        REQUIRE(queue.oldest() == (radrpc::time_point::max)());
+        auto push = create_push(1, send_priority::broadcast);
+        push->body.resize(10);
+        push->conflate = true;
+        queue.push(push);
+        queue.push(create_push(2, send_priority::response));
+        REQUIRE(queue.bytes() == header_size * 2 + 10);
+        REQUIRE(queue.oldest() >= before);
+        REQUIRE(queue.oldest() <= std::chrono::steady_clock::now());
+        auto replacing = create_push(3, send_priority::broadcast);
+        replacing->shared_body = std::make_shared<std::vector<char>>(20);
+        replacing->conflate = true;
+        REQUIRE(queue.conflated(*replacing) == push.get());
+        REQUIRE(queue.conflated(*create_push(4, send_priority::broadcast)) ==
+                nullptr);
+        REQUIRE(queue.replace(replacing));
+        REQUIRE(queue.bytes() == header_size * 2 + 20);
+        queue.clear(send_priority::broadcast);
+        REQUIRE(queue.size() == 1);
+        REQUIRE(queue.bytes() == header_size);
+        radrpc::time_point queued;
+        REQUIRE(queue.pop(queued)->header.call_id == 2);
+        REQUIRE(queued >= before);
+        REQUIRE(queue.bytes() == 0);
+        REQUIRE(queue.oldest() == (radrpc::time_point::max)());
+    }
+}
+
+TEST_CASE("thread placement")
+{
+    using namespace radrpc::detail;
+
+    SECTION("parse cpu list")
+    {
+        REQUIRE(parse_cpulist("").empty());
+        REQUIRE(parse_cpulist("0") == std::vector<unsigned int>{0});
+        REQUIRE(parse_cpulist("0-3,8,10-11\n") ==
+                std::vector<unsigned int>{0, 1, 2, 3, 8, 10, 11});
+    }
+
+    SECTION("placement cpus")
+    {
+        thread_placement placement;
+        REQUIRE(placement_nodes(placement).empty());
+        REQUIRE(placement_cpus(placement, {}, 0).empty());
+        REQUIRE_FALSE(apply_placement(placement, {}, 0));
+
+        placement.mode = placement_mode::cpus;
+        REQUIRE(placement_cpus(placement, {}, 0).empty());
+        placement.cpus = {2, 5};
+        REQUIRE(placement_nodes(placement).empty());
+        REQUIRE(placement_cpus(placement, {}, 0) ==
+                std::vector<unsigned int>{2});
+        REQUIRE(placement_cpus(placement, {}, 1) ==
+                std::vector<unsigned int>{5});
+        REQUIRE(placement_cpus(placement, {}, 2) ==
+                std::vector<unsigned int>{2});
+
+        auto nodes = numa_nodes();
+        REQUIRE_FALSE(nodes.empty());
+        placement.mode = placement_mode::compact;
+        REQUIRE(placement_nodes(placement) == nodes);
+        REQUIRE(placement_cpus(placement, nodes, 0) ==
+                std::vector<unsigned int>{nodes[0][0]});
+        placement.mode = placement_mode::scatter;
+        REQUIRE(placement_cpus(placement, nodes, 0) ==
+                std::vector<unsigned int>{nodes[0][0]});
+        placement.mode = placement_mode::numa_node;
+        REQUIRE(placement_nodes(placement) ==
+                std::vector<std::vector<unsigned int>>{nodes[0]});
+        REQUIRE(placement_cpus(placement, {nodes[0]}, 0) == nodes[0]);
+
+        // Placed by the passed topology
+        std::vector<std::vector<unsigned int>> topology{{0, 1}, {4}};
+        placement.mode = placement_mode::compact;
+        REQUIRE(placement_cpus(placement, topology, 2) ==
+                std::vector<unsigned int>{4});
+        placement.mode = placement_mode::scatter;
+        REQUIRE(placement_cpus(placement, topology, 1) ==
+                std::vector<unsigned int>{4});
+        REQUIRE(placement_cpus(placement, topology, 2) ==
+                std::vector<unsigned int>{1});
+        placement.mode = placement_mode::numa_node;
+        REQUIRE(placement_cpus(placement, {{}}, 0).empty());
+    }
+
+    SECTION("numa nodes without cpus")
+    {
+        namespace fs = boost::filesystem;
+        auto root = fs::temp_directory_path() / fs::unique_path();
+        auto write = [&](const std::string &file, const std::string &text) {
+            fs::create_directories((root / file).parent_path());
+            std::ofstream((root / file).string()) << text;
+        };
+        // Sparse ids with a memory-only node 2
+        write("online", "0,2-3\n");
+        write("node0/cpulist", "0-1\n");
+        write("node2/cpulist", "\n");
+        write("node3/cpulist", "4\n");
+        auto dir = root.string() + "/";
+        REQUIRE(numa_nodes(dir) == std::vector<std::vector<unsigned int>>{
+                                       {0, 1}, {4}});
+        REQUIRE(numa_node_cpus(2, dir).empty());
+        REQUIRE(numa_node_cpus(3, dir) == std::vector<unsigned int>{4});
+        REQUIRE(numa_node_cpus(5, dir).empty());
+        fs::remove_all(root);
+        REQUIRE_FALSE(numa_nodes(dir).empty());
+        REQUIRE_FALSE(numa_node_cpus(0, dir).empty());
+    }
+}
+
+TEST_CASE("busy poll")
+{
+    using namespace radrpc::detail;
+    boost::asio::io_context io_ctx;
+    int executed = 0;
+
+    SECTION("without spin budget")
+    {
+        boost::asio::post(io_ctx, [&] { executed++; });
+        run_busy_poll(io_ctx, radrpc::duration::zero());
+        REQUIRE(executed == 1);
+        REQUIRE(io_ctx.stopped());
+    }
+
+    SECTION("with spin budget")
+    {
+        boost::asio::steady_timer timer(io_ctx);
+        timer.expires_after(std::chrono::milliseconds(20));
+        timer.async_wait([&](const boost::system::error_code &) {
+            boost::asio::post(io_ctx, [&] { executed++; });
+        });
+        boost::asio::post(io_ctx, [&] { executed++; });
+        run_busy_poll(io_ctx, std::chrono::milliseconds(1));
+        REQUIRE(executed == 2);
+        REQUIRE(io_ctx.stopped());
+    }
+
+    SECTION("leave after the handler")
+    {
+        for (auto spin_budget :
+             {radrpc::duration::zero(),
+              radrpc::duration(std::chrono::milliseconds(1))})
+        {
+            bool leave = false;
+            executed = 0;
+            boost::asio::post(io_ctx, [&] {
+                executed++;
+                leave = true;
+            });
+            boost::asio::post(io_ctx, [&] { executed++; });
+            run_busy_poll(io_ctx, spin_budget, &leave);
+            REQUIRE(executed == 1);
+            REQUIRE_FALSE(io_ctx.stopped());
+            leave = false;
+            run_busy_poll(io_ctx, spin_budget, &leave);
+            REQUIRE(executed == 2);
+            REQUIRE(io_ctx.stopped());
+            io_ctx.restart();
+        }
+    }
+}
+
+TEST_CASE("session_registry implementation")
+{
+    using namespace radrpc::detail;
+    using namespace radrpc::impl::server;
+    struct dummy_session
+    {
+        int sent = 0;
+        bool send(const std::shared_ptr<data_push> &)
+        {
+            sent++;
+            return true;
+        }
+    };
+    session_registry registry;
+    auto s1 = std::make_shared<dummy_session>();
+    auto s2 = std::make_shared<dummy_session>();
+    auto s3 = std::make_shared<dummy_session>();
+    registry.add(0x1000, s1);
+    registry.add(0x2000, s2);
+    registry.add(0x3000, s3);
+    REQUIRE(registry.size() == 3);
+    auto push = std::make_shared<data_push>(io_header(1, 0));
+
+    SECTION("send to all")
+    {
+        registry.for_each(
+            [&](const session_registry::entry &e) { REQUIRE(e.send(push)); });
+        REQUIRE(s1->sent == 1);
+        REQUIRE(s2->sent == 1);
+        REQUIRE(s3->sent == 1);
+    }
+
+    SECTION("send to ids")
+    {
+        std::vector<uint64_t> ids{0x1000, 0x3000, 0x4000};
+        int found = 0;
+        registry.for_each(ids, [&](const session_registry::entry &e) {
+            found++;
+            e.send(push);
+        });
+        REQUIRE(found == 2);
+        REQUIRE(s1->sent == 1);
+        REQUIRE(s2->sent == 0);
+        REQUIRE(s3->sent == 1);
+    }
+
+    SECTION("remove & expire")
+    {
+        registry.remove(0x2000);
+        registry.remove(0x5000);
+        REQUIRE(registry.size() == 2);
+        s3.reset();
+        int sent = 0;
+        registry.for_each([&](const session_registry::entry &e) {
+            if (e.send(push))
+                sent++;
+        });
+        // The expired session is skipped without a failure
+        REQUIRE(sent == 2);
+        REQUIRE(s1->sent == 1);
+    }
+
+    SECTION("snapshot is stable while modified")
+    {
+        int visited = 0;
+        registry.for_each([&](const session_registry::entry &e) {
+            visited++;
+            registry.remove(e.id);
+        });
+        REQUIRE(visited == 3);
+        REQUIRE(registry.size() == 0);
+    }
+
+    SECTION("subscribe & unsubscribe")
+    {
+        REQUIRE(registry.subscribe(0x1000, "a"));
+        REQUIRE(registry.subscribe(0x1000, "a"));
+        REQUIRE(registry.subscribe(0x3000, "a"));
+        REQUIRE(registry.subscribe(0x3000, "b"));
+        REQUIRE_FALSE(registry.subscribe(0x4000, "a"));
+        REQUIRE(registry.subscribers("a") == 2);
+        REQUIRE(registry.subscribers("b") == 1);
+        REQUIRE(registry.subscribers("c") == 0);
+        registry.for_each_subscriber(
+            "a", [&](const session_registry::entry &e) { e.send(push); });
+        REQUIRE(s1->sent == 1);
+        REQUIRE(s2->sent == 0);
+        REQUIRE(s3->sent == 1);
+        auto subscribers = registry.subscribers_of("a");
+        REQUIRE(registry.subscribers_of("c") == nullptr);
+        REQUIRE(registry.unsubscribe(0x1000, "a"));
+        REQUIRE_FALSE(registry.unsubscribe(0x1000, "a"));
+        REQUIRE_FALSE(registry.unsubscribe(0x2000, "a"));
+        REQUIRE(registry.subscribers("a") == 1);
+        // The loaded snapshot is not affected
+        REQUIRE(subscribers->size() == 2);
+    }
+
+    SECTION("remove drops subscriptions")
+    {
+        REQUIRE(registry.subscribe(0x2000, "a"));
+        REQUIRE(registry.subscribe(0x2000, "b"));
+        REQUIRE(registry.subscribe(0x3000, "b"));
+        registry.remove(0x2000);
+        REQUIRE(registry.subscribers("a") == 0);
+        REQUIRE(registry.subscribers("b") == 1);
+        REQUIRE_FALSE(registry.unsubscribe(0x2000, "b"));
+    }
+
+    SECTION("subscribe races remove")
+    {
+        for (int round = 0; round < 100; ++round)
+        {
+            registry.add(0x2000, s2);
+            std::thread subscriber([&]() { registry.subscribe(0x2000, "a"); });
+            registry.remove(0x2000);
+            subscriber.join();
+            REQUIRE(registry.subscribers("a") == 0);
+        }
+        // A new session with the same id starts without subscriptions
+        REQUIRE_FALSE(registry.subscribe(0x2000, "a"));
+        registry.add(0x2000, s2);
+        REQUIRE(registry.subscribe(0x2000, "a"));
+        REQUIRE(registry.subscribers("a") == 1);
+    }
+}
+
+TEST_CASE("mpsc_ring implementation")
+{
+    using namespace radrpc::detail;
+
+    SECTION("push & pop")
+    {
+        mpsc_ring<int, 4> ring;
+        int value = 0;
+        REQUIRE_FALSE(ring.pop(value));
+        for (int i = 0; i < 4; ++i)
+            REQUIRE(ring.push(i));
+        REQUIRE_FALSE(ring.push(4));
+        for (int i = 0; i < 4; ++i)
+        {
+            REQUIRE(ring.pop(value));
+            REQUIRE(value == i);
+        }
+        REQUIRE_FALSE(ring.pop(value));
+        REQUIRE(ring.push(5));
+        REQUIRE(ring.pop(value));
+        REQUIRE(value == 5);
+    }
+
+    SECTION("multiple producers")
+    {
+        constexpr int producers = 4;
+        constexpr int items = 10000;
+        mpsc_ring<std::pair<int, int>, 16> ring;
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; ++p)
+        {
+            threads.emplace_back([&ring, p] {
+                for (int i = 0; i < items; ++i)
+                    while (!ring.push(std::make_pair(p, i)))
+                        std::this_thread::yield();
+            });
+        }
+        std::vector<int> next(producers, 0);
+        bool order_ok = true;
+        int popped = 0;
+        std::pair<int, int> value;
+        while (popped < producers * items)
+        {
+            if (!ring.pop(value))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            if (value.second != next[value.first])
+                order_ok = false;
+            next[value.first]++;
+            popped++;
+        }
+        for (auto &thread : threads)
+            thread.join();
+        REQUIRE(order_ok);
+        REQUIRE_FALSE(ring.pop(value));
+    }
+}
+
+TEST_CASE("admission_control implementation")
+{
+    using namespace radrpc::impl::server;
+    using ms = std::chrono::milliseconds;
+    admission_control admission(ms(1), ms(20));
+    REQUIRE(admission.enabled());
+    REQUIRE_FALSE(
+        admission_control(radrpc::duration::zero(), ms(20)).enabled());
+    // The first interval only measures
+    auto received = std::chrono::steady_clock::now() - ms(10);
+    REQUIRE(admission.admit(received));
+    REQUIRE(admission.admit(received));
+    sleep_ms(30);
+    // The minimum stayed above the target, late requests are shed
+    REQUIRE_FALSE(admission.admit(received));
+    REQUIRE(admission.admit(std::chrono::steady_clock::now()));
+    REQUIRE(admission.stats().overloaded);
+    sleep_ms(30);
+    // A request was dispatched quickly, so it recovered
+    REQUIRE(admission.admit(std::chrono::steady_clock::now() - ms(10)));
+    auto stats = admission.stats();
+    REQUIRE_FALSE(stats.overloaded);
+    REQUIRE(stats.admitted == 4);
+    REQUIRE(stats.shed == 1);
+}
+
+TEST_CASE("bulkhead implementation")
+{
+    using namespace radrpc;
+    using namespace radrpc::impl::server;
+    call_policy policy;
+    policy.max_concurrent = 1;
+    policy.max_queued = 2;
+    policy.overflow = overflow_action::queue;
+    bulkhead limit(policy);
+    std::vector<uint64_t> resumed;
+    auto queue = [&]() {
+        uint64_t unused = 0;
+        return limit.acquire(
+            [&resumed](uint64_t generation) { resumed.push_back(generation); },
+            unused);
+    };
+    uint64_t generation = 0;
+    REQUIRE(limit.acquire([](uint64_t) {}, generation) ==
+            bulkhead::result::acquired);
+    REQUIRE(queue() == bulkhead::result::queued);
+    REQUIRE(queue() == bulkhead::result::queued);
+    REQUIRE(queue() == bulkhead::result::rejected);
+
+    SECTION("pass the slot")
+    {
+        limit.release(generation);
+        REQUIRE(resumed == std::vector<uint64_t>{generation});
+        limit.release(resumed[0]);
+        limit.release(resumed[1]);
+        auto stats = limit.stats();
+        REQUIRE(stats.executing == 0);
+        REQUIRE(stats.queued == 0);
+        REQUIRE(stats.executed == 3);
+        REQUIRE(stats.rejected == 1);
+    }
+
+    SECTION("clear releases the slots")
+    {
+        // Passed to a handler, which may not be called anymore
+        limit.release(generation);
+        limit.clear();
+        REQUIRE(limit.stats().executing == 0);
+        REQUIRE(limit.stats().queued == 0);
+        uint64_t next = 0;
+        REQUIRE(limit.acquire([](uint64_t) {}, next) ==
+                bulkhead::result::acquired);
+        // The late release of a slot before the clear is ignored
+        limit.release(resumed[0]);
+        REQUIRE(limit.stats().executing == 1);
+        limit.release(next);
+        REQUIRE(limit.stats().executing == 0);
+    }
+}
+
+TEST_CASE("fair_scheduler implementation")
+{
+    using namespace radrpc::impl::server;
+    fair_scheduler scheduler(1);
+    REQUIRE(scheduler.enabled());
+    REQUIRE_FALSE(fair_scheduler(0).enabled());
+    std::string order;
+    uint64_t generation = 0;
+    auto queue = [&](const std::string &tenant, unsigned int weight) {
+        return scheduler.acquire(
+            tenant,
+            weight,
+            [&order, tenant](uint64_t) { order += tenant; },
+            generation);
+    };
+    REQUIRE(queue("x", 1) == fair_scheduler::result::acquired);
+
+    SECTION("equal weights")
+    {
+        for (int i = 0; i < 4; ++i)
+            REQUIRE(queue("a", 1) == fair_scheduler::result::queued);
+        for (int i = 0; i < 2; ++i)
+            REQUIRE(queue("b", 1) == fair_scheduler::result::queued);
+        REQUIRE(scheduler.waiting() == 6);
+        for (int i = 0; i < 7; ++i)
+            scheduler.release(generation);
+        REQUIRE(order == "ababaa");
+    }
+
+    SECTION("weighted")
+    {
+        for (int i = 0; i < 4; ++i)
+            queue("a", 2);
+        for (int i = 0; i < 3; ++i)
+            queue("b", 1);
+        queue("c", 0);
+        for (int i = 0; i < 9; ++i)
+            scheduler.release(generation);
+        REQUIRE(order == "aabcaabb");
+    }
+
+    SECTION("weight of the first request")
+    {
+        queue("a", 2);
+        for (int i = 0; i < 3; ++i)
+            queue("a", 1);
+        for (int i = 0; i < 2; ++i)
+            queue("b", 1);
+        for (int i = 0; i < 7; ++i)
+            scheduler.release(generation);
+        REQUIRE(order == "aabaab");
+    }
+
+    SECTION("clear")
+    {
+        queue("a", 1);
+        auto cleared = generation;
+        scheduler.clear();
+        REQUIRE(scheduler.waiting() == 0);
+        // The slot passed before is released by the clear
+        REQUIRE(queue("a", 1) == fair_scheduler::result::acquired);
+        REQUIRE(queue("b", 1) == fair_scheduler::result::queued);
+        scheduler.release(cleared);
+        REQUIRE(order.empty());
+        scheduler.release(generation);
+        REQUIRE(order == "b");
+    }
+}
+
+TEST_CASE("token_bucket implementation")
+{
+    using namespace radrpc::detail;
+    using ms = std::chrono::milliseconds;
+
+    SECTION("unlimited")
+    {
+        token_bucket bucket;
+        auto now = std::chrono::steady_clock::now();
+        REQUIRE_FALSE(bucket.enabled());
+        REQUIRE(bucket.wait_time(1000, now) == radrpc::duration::zero());
+    }
+
+    SECTION("burst & refill")
+    {
+        token_bucket bucket(100, 2);
+        auto now = std::chrono::steady_clock::now();
+        REQUIRE(bucket.enabled());
+        for (int i = 0; i < 2; ++i)
+        {
+            REQUIRE(bucket.wait_time(1, now) == radrpc::duration::zero());
+            bucket.consume(1);
+        }
+        auto wait = bucket.wait_time(1, now);
+        REQUIRE(wait > ms(9));
+        REQUIRE(wait <= ms(10));
+        REQUIRE(bucket.wait_time(1, now + ms(10)) ==
+                radrpc::duration::zero());
+        // Refills up to the burst only
+        REQUIRE(bucket.wait_time(2, now + ms(1000)) ==
+                radrpc::duration::zero());
+        bucket.consume(2);
+        REQUIRE(bucket.wait_time(1, now + ms(1000)) > ms(9));
+    }
+
+    SECTION("debt")
+    {
+        token_bucket bucket(1000, 0);
+        auto now = std::chrono::steady_clock::now();
+        // Larger than the burst, waits for a full bucket
+        REQUIRE(bucket.wait_time(5000, now) == radrpc::duration::zero());
+        bucket.consume(5000);
+        auto wait = bucket.wait_time(1, now);
+        REQUIRE(wait > ms(4000));
+        REQUIRE(wait <= ms(4001));
+    }
+
+    SECTION("set rate & refund")
+    {
+        token_bucket bucket(100, 2);
+        auto now = std::chrono::steady_clock::now();
+        bucket.consume(2);
+        // The consumed tokens stay consumed with the new rate
+        bucket.set_rate(10, 4, now);
+        auto wait = bucket.wait_time(1, now);
+        REQUIRE(wait > ms(99));
+        REQUIRE(wait <= ms(100));
+        bucket.refund(1);
+        REQUIRE(bucket.wait_time(1, now) == radrpc::duration::zero());
+        // Refunds up to the burst only
+        bucket.refund(10);
+        REQUIRE(bucket.full(now));
+        REQUIRE(bucket.wait_time(5, now) == radrpc::duration::zero());
+        bucket.consume(4);
+        REQUIRE(bucket.wait_time(1, now) > ms(99));
+        // An unlimited bucket starts full
+        token_bucket unlimited;
+        unlimited.set_rate(10, 2, now);
+        REQUIRE(unlimited.enabled());
+        REQUIRE(unlimited.wait_time(2, now) == radrpc::duration::zero());
+    }
+
+    SECTION("rate_limiter")
+    {
+        radrpc::rate_limit limit;
+        REQUIRE_FALSE(rate_limiter(limit).enabled());
+        limit.bytes_per_sec = 1000;
+        limit.byte_burst = 100;
+        rate_limiter limiter(limit);
+        auto now = std::chrono::steady_clock::now();
+        REQUIRE(limiter.enabled());
+        REQUIRE(limiter.wait_time(100, now) == radrpc::duration::zero());
+        limiter.consume(100);
+        REQUIRE(limiter.wait_time(50, now) > ms(49));
+    }
+}
+
+TEST_CASE("cidr_trie implementation")
+{
+    using namespace radrpc::detail;
+    auto bytes_of = [](const std::string &address) {
+        return to_ip_bytes(boost::asio::ip::make_address(address));
+    };
+    auto insert = [](cidr_trie &trie, const std::string &range, int value) {
+        ip_bytes bytes;
+        unsigned int length;
+        REQUIRE(parse_cidr(range, bytes, length));
+        trie.insert(bytes, length, value);
+    };
+
+    SECTION("parse")
+    {
+        ip_bytes bytes;
+        unsigned int length;
+        REQUIRE(parse_cidr("10.0.0.0/8", bytes, length));
+        REQUIRE(length == 104);
+        REQUIRE(parse_cidr("127.0.0.1", bytes, length));
+        REQUIRE(length == 128);
+        REQUIRE(parse_cidr("2001:db8::/32", bytes, length));
+        REQUIRE(length == 32);
+        REQUIRE_FALSE(parse_cidr("10.0.0.0/33", bytes, length));
+        REQUIRE_FALSE(parse_cidr("10.0.0.0/", bytes, length));
+        REQUIRE_FALSE(parse_cidr("10.0.0.0/-1", bytes, length));
+        REQUIRE_FALSE(parse_cidr("localhost", bytes, length));
+    }
+
+    SECTION("most specific range")
+    {
+        cidr_trie trie;
+        REQUIRE(trie.match(bytes_of("10.1.2.3")) == -1);
+        insert(trie, "10.0.0.0/8", 0);
+        insert(trie, "10.1.0.0/16", 1);
+        insert(trie, "10.1.2.3", 0);
+        insert(trie, "10.128.0.0/9", 1);
+        insert(trie, "2001:db8::/32", 1);
+        REQUIRE(trie.match(bytes_of("10.2.0.1")) == 0);
+        REQUIRE(trie.match(bytes_of("10.1.0.1")) == 1);
+        REQUIRE(trie.match(bytes_of("10.1.2.3")) == 0);
+        REQUIRE(trie.match(bytes_of("10.1.2.4")) == 1);
+        REQUIRE(trie.match(bytes_of("10.200.0.1")) == 1);
+        REQUIRE(trie.match(bytes_of("11.0.0.1")) == -1);
+        REQUIRE(trie.match(bytes_of("2001:db8::1")) == 1);
+        REQUIRE(trie.match(bytes_of("2001:db9::1")) == -1);
+        // Inserted in reverse order
+        cidr_trie reversed;
+        insert(reversed, "10.1.2.3", 0);
+        insert(reversed, "10.128.0.0/9", 1);
+        insert(reversed, "10.1.0.0/16", 1);
+        insert(reversed, "10.0.0.0/8", 0);
+        REQUIRE(reversed.match(bytes_of("10.2.0.1")) == 0);
+        REQUIRE(reversed.match(bytes_of("10.1.0.1")) == 1);
+        REQUIRE(reversed.match(bytes_of("10.1.2.3")) == 0);
+        REQUIRE(reversed.match(bytes_of("10.200.0.1")) == 1);
+    }
+
+    SECTION("default route")
+    {
+        cidr_trie trie;
+        insert(trie, "0.0.0.0/0", 1);
+        insert(trie, "::/0", 0);
+        REQUIRE(trie.match(bytes_of("1.2.3.4")) == 1);
+        REQUIRE(trie.match(bytes_of("::1")) == 0);
+    }
+}
+
+TEST_CASE("ip_admission implementation")
+{
+    using namespace radrpc::impl::server;
+    typedef ip_admission::connection_ref connection_ref;
+    auto local = boost::asio::ip::make_address("127.0.0.1");
+    auto other = boost::asio::ip::make_address("192.168.0.1");
+    radrpc::ip_policy policy;
+
+    SECTION("allow & deny")
+    {
+        policy.allow = {"127.0.0.0/8"};
+        policy.deny = {"127.0.0.2"};
+        auto filter = std::make_shared<ip_admission>(policy);
+        connection_ref ref;
+        REQUIRE(filter->admit(local, ref));
+        REQUIRE_FALSE(
+            filter->admit(boost::asio::ip::make_address("127.0.0.2"), ref));
+        REQUIRE_FALSE(filter->admit(other, ref));
+        // Only the admitted connection is counted
+        REQUIRE(filter->addresses() == 1);
+        // Reloaded
+        policy.allow.push_back("invalid");
+        REQUIRE_FALSE(filter->set(policy));
+        REQUIRE_FALSE(filter->admit(other, ref));
+        REQUIRE(filter->set(radrpc::ip_policy()));
+        REQUIRE(filter->admit(other, ref));
+        // The reference releases its previous address
+        REQUIRE(filter->addresses() == 1);
+    }
+
+    SECTION("connections per address")
+    {
+        policy.max_connections = 2;
+        auto filter = std::make_shared<ip_admission>(policy);
+        auto io_ref = std::make_shared<char>();
+        auto ref1 = std::make_shared<connection_ref>(io_ref);
+        auto ref2 = std::make_shared<connection_ref>(io_ref);
+        auto ref3 = std::make_shared<connection_ref>(io_ref);
+        REQUIRE(filter->admit(local, *ref1));
+        REQUIRE(filter->admit(local, *ref2));
+        REQUIRE_FALSE(filter->admit(local, *ref3));
+        REQUIRE(filter->admit(other, *ref3));
+        // Still referenced by each connection
+        REQUIRE(io_ref.use_count() == 4);
+        ref1.reset();
+        auto ref4 = std::make_shared<connection_ref>(io_ref);
+        REQUIRE(filter->admit(local, *ref4));
+        // Moved with the io context
+        connection_ref moved(std::move(*ref4));
+        ref4.reset();
+        REQUIRE_FALSE(filter->admit(local, *ref3));
+        ref2.reset();
+        ref3.reset();
+        REQUIRE(io_ref.use_count() == 2);
+        REQUIRE(filter->addresses() == 1);
+    }
+
+    SECTION("counted without limits")
+    {
+        auto filter = std::make_shared<ip_admission>(policy);
+        connection_ref ref1, ref2;
+        REQUIRE(filter->admit(local, ref1));
+        REQUIRE(filter->admit(local, ref2));
+        REQUIRE(filter->addresses() == 1);
+        // The connections opened before are part of the limit
+        policy.max_connections = 2;
+        REQUIRE(filter->set(policy));
+        connection_ref ref3;
+        REQUIRE_FALSE(filter->admit(local, ref3));
+        REQUIRE(filter->admit(other, ref3));
+    }
+
+    SECTION("many addresses")
+    {
+        policy.max_connections = 1;
+        auto filter = std::make_shared<ip_admission>(policy);
+        std::vector<std::unique_ptr<connection_ref>> refs;
+        for (unsigned int i = 0; i < 3000; ++i)
+        {
+            auto address = boost::asio::ip::make_address_v4(0x0A000000 + i);
+            refs.emplace_back(new connection_ref());
+            REQUIRE(filter->admit(address, *refs.back()));
+            REQUIRE_FALSE(filter->admit(address, *refs.back()));
+        }
+        REQUIRE(filter->addresses() == 3000);
+        // Released out of order, the others are still found
+        for (unsigned int i = 0; i < 3000; i += 2)
+            refs[i].reset();
+        REQUIRE(filter->addresses() == 1500);
+        for (unsigned int i = 0; i < 3000; ++i)
+        {
+            auto address = boost::asio::ip::make_address_v4(0x0A000000 + i);
+            connection_ref ref;
+            REQUIRE(filter->admit(address, ref) == (i % 2 == 0));
+        }
+        refs.clear();
+        REQUIRE(filter->addresses() == 0);
+    }
+
+    SECTION("accept rate")
+    {
+        policy.accepts_per_sec = 10;
+        policy.accept_burst = 2;
+        auto filter = std::make_shared<ip_admission>(policy);
+        connection_ref ref;
+        REQUIRE(filter->admit(local, ref));
+        REQUIRE(filter->admit(local, ref));
+        REQUIRE_FALSE(filter->admit(local, ref));
+        REQUIRE(filter->admit(other, ref));
+        sleep_ms(150);
+        REQUIRE(filter->admit(local, ref));
+    }
+
+    SECTION("refund")
+    {
+        policy.accepts_per_sec = 1;
+        policy.accept_burst = 1;
+        auto filter = std::make_shared<ip_admission>(policy);
+        connection_ref ref;
+        REQUIRE(filter->admit(local, ref));
+        filter->refund(local);
+        REQUIRE(filter->admit(local, ref));
+        REQUIRE_FALSE(filter->admit(local, ref));
+        // Unknown addresses are ignored
+        filter->refund(other);
+        REQUIRE(filter->admit(other, ref));
+    }
+
+    SECTION("reload keeps the accepts")
+    {
+        policy.accepts_per_sec = 1;
+        policy.accept_burst = 2;
+        auto filter = std::make_shared<ip_admission>(policy);
+        connection_ref ref;
+        REQUIRE(filter->admit(local, ref));
+        REQUIRE(filter->admit(local, ref));
+        REQUIRE_FALSE(filter->admit(local, ref));
+        // The exhausted address isn't refilled by a reload
+        policy.accept_burst = 4;
+        REQUIRE(filter->set(policy));
+        REQUIRE_FALSE(filter->admit(local, ref));
+        REQUIRE(filter->admit(other, ref));
+    }
+}
+
+TEST_CASE("timer_wheel implementation")
+{
+    using namespace radrpc::impl::server;
+    using ms = std::chrono::milliseconds;
+    static std::vector<int> expired;
+    expired.clear();
+    boost::asio::io_context io_ctx;
+    auto wheel = std::make_shared<timer_wheel>(io_ctx.get_executor(), ms(1));
+    auto handler = [](std::shared_ptr<void> owner) {
+        expired.push_back(*std::static_pointer_cast<int>(owner));
+    };
+    std::vector<std::shared_ptr<int>> owners;
+    std::vector<timer_wheel::entry> entries(4);
+    for (int i = 0; i < 4; ++i)
+    {
+        owners.push_back(std::make_shared<int>(i));
+        entries[i].owner = owners.back();
+        entries[i].expire = handler;
+    }
+
+    SECTION("expire in order")
+    {
+        wheel->schedule(entries[0], ms(30));
+        wheel->schedule(entries[1], ms(10));
+        wheel->schedule(entries[2], ms(100));
+        wheel->schedule(entries[3], ms(20));
+        REQUIRE(wheel->size() == 4);
+        REQUIRE(wheel->pending(entries[2]));
+        io_ctx.run_for(ms(50));
+        REQUIRE(expired == std::vector<int>({1, 3, 0}));
+        REQUIRE(wheel->size() == 1);
+        REQUIRE_FALSE(wheel->pending(entries[0]));
+        // Cascaded from the second level
+        io_ctx.run_for(ms(100));
+        REQUIRE(expired == std::vector<int>({1, 3, 0, 2}));
+        REQUIRE(wheel->size() == 0);
+    }
+
+    SECTION("reschedule & cancel")
+    {
+        wheel->schedule(entries[0], ms(10));
+        wheel->schedule(entries[1], ms(20));
+        wheel->schedule(entries[2], ms(30));
+        wheel->schedule(entries[0], ms(40));
+        wheel->cancel(entries[1]);
+        wheel->cancel(entries[1]);
+        REQUIRE(wheel->size() == 2);
+        io_ctx.run_for(ms(80));
+        REQUIRE(expired == std::vector<int>({2, 0}));
+    }
+
+    SECTION("destroyed owner")
+    {
+        wheel->schedule(entries[0], ms(10));
+        wheel->schedule(entries[1], ms(10));
+        owners[0].reset();
+        io_ctx.run_for(ms(40));
+        REQUIRE(expired == std::vector<int>({1}));
+        REQUIRE(wheel->size() == 0);
+    }
+
+    SECTION("restart after idle")
+    {
+        wheel->schedule(entries[0], ms(5));
+        io_ctx.run_for(ms(20));
+        REQUIRE(expired.size() == 1);
+        // Stopped ticking, the wheel catches up on schedule
+        sleep_ms(20);
+        io_ctx.restart();
+        auto start = std::chrono::steady_clock::now();
+        wheel->schedule(entries[1], ms(10));
+        io_ctx.run();
+        REQUIRE(expired.size() == 2);
+        REQUIRE(std::chrono::steady_clock::now() - start >= ms(10));
+    }
+}
+
+TEST_CASE("buffer_pool implementation")
+{
+    using namespace radrpc::detail;
+    const std::size_t kb = 1024;
+    auto pool = std::make_shared<buffer_pool>(1024 * kb);
+
+    // Sizes above the thread caches go to the shared pool
+    SECTION("reuse by size class")
+    {
+        auto p1 = pool->allocate(100 * kb);
+        auto p2 = pool->allocate(300 * kb);
+        REQUIRE(pool->stats().misses == 2);
+        pool->deallocate(p1, 100 * kb);
+        pool->deallocate(p2, 300 * kb);
+        REQUIRE(pool->stats().pooled_bytes == 128 * kb + 512 * kb);
+        // Same class, so the released buffer is reused
+        REQUIRE(pool->allocate(120 * kb) == p1);
+        REQUIRE(pool->allocate(512 * kb) == p2);
+        REQUIRE(pool->stats().hits == 2);
+        REQUIRE(pool->stats().pooled_bytes == 0);
+        pool->deallocate(p1, 120 * kb);
+        pool->deallocate(p2, 512 * kb);
+        pool->clear();
+        REQUIRE(pool->stats().pooled_bytes == 0);
+    }
+
+    SECTION("limit")
+    {
+        auto p1 = pool->allocate(1024 * kb);
+        auto p2 = pool->allocate(128 * kb);
+        auto large = pool->allocate(4 * 1024 * kb);
+        pool->deallocate(p1, 1024 * kb);
+        // Freed since the pool is full or too large to pool
+        pool->deallocate(p2, 128 * kb);
+        pool->deallocate(large, 4 * 1024 * kb);
+        REQUIRE(pool->stats().pooled_bytes == 1024 * kb);
+        REQUIRE(pool->stats().misses == 2);
+    }
+
+    SECTION("flat buffer")
+    {
+        {
+            pooled_flat_buffer buffer{pool_allocator<char>(pool)};
+            buffer.commit(boost::asio::buffer_copy(
+                buffer.prepare(100 * kb),
+                boost::asio::buffer(std::string(100 * kb, 'x'))));
+            REQUIRE(buffer.size() == 100 * kb);
+            buffer.consume(buffer.size());
+            buffer.shrink_to_fit();
+            REQUIRE(pool->stats().pooled_bytes == 128 * kb);
+            buffer.prepare(120 * kb);
+            REQUIRE(pool->stats().hits == 1);
+        }
+        REQUIRE(pool->stats().pooled_bytes == 128 * kb);
+        pooled_flat_buffer heap_buffer;
+        heap_buffer.prepare(100);
+        REQUIRE(pool->stats().misses == 1);
+    }
+
+    SECTION("worker cache")
+    {
+        void *p1 = nullptr, *p2 = nullptr, *r1 = nullptr, *r2 = nullptr;
+        buffer_pool_stats stats;
+        std::thread([&]() {
+            buffer_pool::worker_scope scope(pool);
+            p1 = pool->allocate(1000);
+            p2 = pool->allocate(1000);
+            pool->deallocate(p1, 1000);
+            pool->deallocate(p2, 1000);
+            stats = pool->stats();
+            r1 = pool->allocate(1000);
+            r2 = pool->allocate(1000);
+            pool->deallocate(r1, 1000);
+            pool->deallocate(r2, 1000);
+        }).join();
+        REQUIRE(stats.misses == 2);
+        REQUIRE(stats.pooled_bytes == 2 * kb);
+        REQUIRE(r1 == p2);
+        REQUIRE(r2 == p1);
+        // The cached buffers are moved to the shared pool on detach
+        REQUIRE(pool->stats().hits == 2);
+        REQUIRE(pool->stats().pooled_bytes == 2 * kb);
+        auto p3 = pool->allocate(1000);
+        REQUIRE(p3 == p1);
+        REQUIRE(pool->stats().hits == 3);
+        pool->deallocate(p3, 1000);
+        pool->clear();
+        REQUIRE(pool->stats().pooled_bytes == 0);
+    }
+
+    SECTION("worker cache clear")
+    {
+        buffer_pool_stats cleared, flushed;
+        std::thread([&]() {
+            buffer_pool::worker_scope scope(pool);
+            pool->deallocate(pool->allocate(1000), 1000);
+            pool->clear();
+            cleared = pool->stats();
+            // The worker frees its cache on the next use
+            pool->deallocate(pool->allocate(1000), 1000);
+            flushed = pool->stats();
+        }).join();
+        REQUIRE(cleared.pooled_bytes == 1 * kb);
+        REQUIRE(flushed.pooled_bytes == 1 * kb);
+        REQUIRE(flushed.misses == 2);
+        REQUIRE(flushed.hits == 0);
+    }
+
+    SECTION("worker cache limit")
+    {
+        auto small_pool = std::make_shared<buffer_pool>(2 * kb);
+        buffer_pool_stats stats;
+        std::thread([&]() {
+            buffer_pool::worker_scope scope(small_pool);
+            // Attached to one pool, the other one is shared
+            buffer_pool::worker_scope other(pool);
+            auto p1 = small_pool->allocate(1000);
+            auto p2 = small_pool->allocate(1000);
+            auto p3 = small_pool->allocate(1000);
+            small_pool->deallocate(p1, 1000);
+            small_pool->deallocate(p2, 1000);
+            // Freed since the cached buffers fill the limit
+            small_pool->deallocate(p3, 1000);
+            stats = small_pool->stats();
+            pool->deallocate(pool->allocate(1000), 1000);
+        }).join();
+        REQUIRE(stats.pooled_bytes == 2 * kb);
+        REQUIRE(pool->stats().pooled_bytes == 1 * kb);
+    }
+
+    SECTION("pooled vector")
+    {
+        pooled_vector bytes{pool_allocator<char>(pool)};
+        bytes.assign(200 * kb, 'x');
+        data_push push(io_header(1, 0));
+        push.pooled_body = std::move(bytes);
+        REQUIRE(push.body_buffer().size() == 200 * kb);
+        REQUIRE(push.size() == sizeof(io_header) + 200 * kb);
+        // The body is released to the pool it was drawn from
+        push.pooled_body = pooled_vector();
+        REQUIRE(pool->stats().pooled_bytes == 256 * kb);
+        push.body = {'x'};
+        REQUIRE(push.body_buffer().size() == 1);
+    }
+}
@@ -22,7 +22,9 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  */
 
+#include <algorithm>
 #include <csignal>
+#include <set>
 
 #include <test/defaults/default_config.hpp>
 #include <test/dep/catch.hpp>
@@ -212,6 +214,343 @@ TEST_CASE("plain server implementation")
         srv->stop();
     }
 
+    SECTION("broadcast order")
+    {
+        auto cfg = default_server_config();
+        cfg.workers = 3;
+        for (auto parallel : {true, false})
+        {
+            cfg.parallel_broadcast = parallel;
+            auto srv = plain_create_server(cfg);
+            srv->async_start();
+            sleep_ms(sleep_high_delay_ms);
+            std::atomic<int> received = ATOMIC_VAR_INIT(0);
+            std::atomic<bool> order_ok = ATOMIC_VAR_INIT(true);
+            auto cl = plain_create_client();
+            auto clients = vector_of_object(cl);
+            std::vector<int> next(3, 0);
+            for (auto i = 0; i < 3; ++i)
+            {
+                clients.emplace_back(plain_create_client());
+                clients[i]->listen_broadcast(
+                    UNIT_RPC_SERVER_MSG, [&, i](receive_buffer &p_data) {
+                        if (p_data.size() != 1 ||
+                            (unsigned char)p_data.data()[0] != next[i])
+                            order_ok = false;
+                        next[i]++;
+                        received++;
+                    });
+                REQUIRE(clients[i]->connect());
+            }
+            sleep_ms(sleep_high_delay_ms);
+            // Exceeds the inbox of the sessions.
+            for (int i = 0; i < 200; ++i)
+                srv->broadcast(UNIT_RPC_SERVER_MSG,
+                               std::vector<char>(1, static_cast<char>(i)));
+            // The queued broadcasts aren't counted as connections.
+            REQUIRE(srv->connections() == 3);
+            sleep_ms(sleep_high_delay_ms);
+            REQUIRE(received == 600);
+            REQUIRE(order_ok);
+            clients.clear();
+            srv->stop();
+        }
+    }
+
+    SECTION("broadcast conflated")
+    {
+        auto srv = plain_create_server();
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        std::atomic<int> received = ATOMIC_VAR_INIT(0);
+        std::atomic<int> last = ATOMIC_VAR_INIT(-1);
+        std::atomic<bool> order_ok = ATOMIC_VAR_INIT(true);
+        auto cl = plain_create_client();
+        cl->listen_broadcast(UNIT_RPC_SERVER_MSG, [&](receive_buffer &p_data) {
+            int value = (unsigned char)p_data.data()[0];
+            if (p_data.size() != 1 || value <= last)
+                order_ok = false;
+            last = value;
+            received++;
+        });
+        REQUIRE(cl->connect());
+        sleep_ms(sleep_high_delay_ms);
+        // Replaced messages are skipped, but the latest always arrives.
+        for (int i = 0; i < 200; ++i)
+        {
+            std::vector<char> msg(1, static_cast<char>(i));
+            srv->broadcast_conflated(
+                UNIT_RPC_SERVER_MSG, UNIT_RPC_SERVER_MSG, std::move(msg));
+        }
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(received >= 1);
+        REQUIRE(received <= 200);
+        REQUIRE(last == 199);
+        REQUIRE(order_ok);
+        srv->stop();
+    }
+
+    SECTION("slow consumer")
+    {
+        auto session_cfg = default_session_config();
+        session_cfg.max_pending_bytes = 1024 * 1024;
+        // The keep alive would close the stalled session as well
+        session_cfg.ping_delay = duration::zero();
+        for (auto action : {slow_consumer_action::warn,
+                            slow_consumer_action::drop,
+                            slow_consumer_action::close})
+        {
+            session_cfg.slow_consumer = action;
+            auto srv = plain_create_server(
+                default_server_config(), default_server_timeout(), session_cfg);
+            std::atomic<int> warned = ATOMIC_VAR_INIT(0);
+            std::atomic<int> received = ATOMIC_VAR_INIT(0);
+            REQUIRE(srv->bind_slow_consumer(
+                [&](const session_info &info, const write_progress &progress) {
+                    if (progress.pending_bytes > 1024 * 1024 &&
+                        progress.pending_messages != 0)
+                        warned++;
+                }));
+            srv->async_start();
+            sleep_ms(sleep_high_delay_ms);
+            auto cl = plain_create_client();
+            // Stalls the reads of the client on the first message.
+            cl->listen_broadcast(UNIT_RPC_SERVER_MSG,
+                                 [&](receive_buffer &p_data) {
+                                     if (received++ == 0)
+                                         sleep_ms(sleep_high_delay_ms * 2);
+                                 });
+            REQUIRE(cl->connect());
+            sleep_ms(sleep_high_delay_ms);
+            auto msg = std::make_shared<const std::vector<char>>(64 * 1024);
+            for (int i = 0; i < 400; ++i)
+                srv->broadcast(UNIT_RPC_SERVER_MSG, msg);
+            sleep_ms(sleep_high_delay_ms * 4);
+            REQUIRE(warned >= 1);
+            if (action == slow_consumer_action::warn)
+                REQUIRE(received == 400);
+            if (action == slow_consumer_action::drop)
+                REQUIRE(received < 400);
+            if (action == slow_consumer_action::close)
+                REQUIRE(srv->connections() == 0);
+            srv->stop();
+        }
+    }
+
+    SECTION("byte budgets")
+    {
+        const uint32_t large_response_id = UNIT_RPC_SERVER_MSG + 3;
+        auto cfg = default_server_config();
+        cfg.max_queued_bytes = 64 * 1024;
+        cfg.parallel_broadcast = false;
+        auto session_cfg = default_session_config();
+        session_cfg.max_queued_bytes = 16 * 1024;
+        session_cfg.ping_delay = duration::zero();
+        auto srv =
+            plain_create_server(cfg, default_server_timeout(), session_cfg);
+        REQUIRE(srv->bind(large_response_id, [&](session_context *ctx) {
+            ctx->response.resize(32 * 1024);
+        }));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        std::atomic<int> received = ATOMIC_VAR_INIT(0);
+        std::atomic<bool> stall = ATOMIC_VAR_INIT(false);
+        auto cl = plain_create_client();
+        cl->listen_broadcast(UNIT_RPC_SERVER_MSG, [&](receive_buffer &p_data) {
+            received++;
+            if (stall.exchange(false))
+                sleep_ms(sleep_high_delay_ms * 4);
+        });
+        REQUIRE(cl->connect());
+        sleep_ms(sleep_high_delay_ms);
+        // Exceeds the server budget
+        REQUIRE_FALSE(srv->broadcast(UNIT_RPC_SERVER_MSG,
+                                     std::vector<char>(128 * 1024)));
+        // Exceeds the session budget
+        REQUIRE_FALSE(srv->broadcast(UNIT_RPC_SERVER_MSG,
+                                     std::vector<char>(32 * 1024)));
+        REQUIRE_FALSE(srv->broadcast(UNIT_RPC_SERVER_MSG,
+                                     std::vector<char>(32 * 1024),
+                                     srv->get_session_ids()));
+        REQUIRE(srv->broadcast(UNIT_RPC_SERVER_MSG, std::vector<char>(1024)));
+        REQUIRE_FALSE((bool)cl->send_recv(large_response_id, {}));
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(received == 1);
+        // Stall the client until the session budget is exhausted,
+        // each accepted broadcast is still delivered.
+        stall = true;
+        REQUIRE(srv->broadcast(UNIT_RPC_SERVER_MSG, std::vector<char>(1)));
+        sleep_ms(sleep_low_delay_ms);
+        int accepted = 1;
+        bool rejected = false;
+        for (int i = 0; i < 10000 && !rejected; ++i)
+        {
+            if (srv->broadcast(UNIT_RPC_SERVER_MSG,
+                               std::vector<char>(8 * 1024)))
+                accepted++;
+            else
+                rejected = true;
+        }
+        REQUIRE(rejected);
+        sleep_ms(sleep_high_delay_ms * 6);
+        REQUIRE(received == accepted + 1);
+        srv->stop();
+    }
+
+    SECTION("read backpressure")
+    {
+        namespace websocket = boost::beast::websocket;
+        const uint32_t large_response_id = UNIT_RPC_SERVER_MSG + 3;
+        const int requests = 1000;
+        // The pings are suspended while paused, instead of closing
+        // the session since the pongs can't be read
+        for (auto ping_delay :
+             {duration::zero(), default_session_config().ping_delay})
+        {
+            auto session_cfg = default_session_config();
+            session_cfg.read_pause_bytes = 256 * 1024;
+            session_cfg.read_resume_bytes = 64 * 1024;
+            session_cfg.ping_delay = ping_delay;
+            auto srv = plain_create_server(
+                default_server_config(), default_server_timeout(), session_cfg);
+            std::atomic<int> executed = ATOMIC_VAR_INIT(0);
+            REQUIRE(srv->bind(large_response_id, [&](session_context *ctx) {
+                executed++;
+                ctx->response.resize(64 * 1024);
+            }));
+            srv->async_start();
+            sleep_ms(sleep_high_delay_ms);
+            // A raw stream to send requests without reading the responses.
+            boost::asio::io_context io_ctx;
+            websocket::stream<boost::asio::ip::tcp::socket> ws(io_ctx);
+            ws.next_layer().connect(boost::asio::ip::tcp::endpoint(
+                boost::asio::ip::make_address("127.0.0.1"),
+                default_server_config().port));
+            ws.handshake("127.0.0.1", "/");
+            ws.binary(true);
+            for (int i = 0; i < requests; ++i)
+            {
+                radrpc::detail::io_header header(large_response_id, i + 1);
+                ws.write(boost::asio::buffer(&header, sizeof(header)));
+            }
+            sleep_ms(sleep_high_delay_ms * 2);
+            std::this_thread::sleep_for(ping_delay * 3);
+            REQUIRE(executed < requests);
+            REQUIRE(srv->connections() == 1);
+            boost::beast::flat_buffer buffer;
+            for (int i = 0; i < requests; ++i)
+            {
+                ws.read(buffer);
+                REQUIRE(buffer.size() ==
+                        sizeof(radrpc::detail::io_header) + 64 * 1024);
+                buffer.consume(buffer.size());
+            }
+            REQUIRE(executed == requests);
+            ws.next_layer().close();
+            srv->stop();
+        }
+        auto invalid_cfg = default_session_config();
+        invalid_cfg.read_pause_bytes = 64 * 1024;
+        invalid_cfg.read_resume_bytes = invalid_cfg.read_pause_bytes + 1;
+        REQUIRE_THROWS(plain_create_server(
+            default_server_config(), default_server_timeout(), invalid_cfg));
+    }
+
+    SECTION("broadcast shared body")
+    {
+        auto msg = std::make_shared<const std::vector<char>>(10, 0x1);
+        std::atomic<int> received = ATOMIC_VAR_INIT(0);
+        std::atomic<bool> msg_ok = ATOMIC_VAR_INIT(true);
+        auto srv = plain_create_server();
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto listen_handler = [&](receive_buffer &p_data) {
+            std::vector<char> recv_msg(p_data.data(),
+                                       p_data.data() + p_data.size());
+            if (recv_msg != *msg)
+                msg_ok = false;
+            received++;
+        };
+        auto cl = plain_create_client();
+        auto clients = vector_of_object(cl);
+        for (auto i = 0; i < 3; ++i)
+        {
+            clients.emplace_back(plain_create_client());
+            clients[i]->listen_broadcast(UNIT_RPC_SERVER_MSG, listen_handler);
+            REQUIRE(clients[i]->connect());
+        }
+        sleep_ms(sleep_high_delay_ms);
+        srv->broadcast(UNIT_RPC_SERVER_MSG, msg);
+        srv->broadcast(UNIT_RPC_SERVER_MSG, msg);
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(received == 6);
+        auto ids = srv->get_session_ids();
+        REQUIRE(ids.size() == 3);
+        srv->broadcast(UNIT_RPC_SERVER_MSG,
+                       std::vector<char>(*msg),
+                       std::vector<uint64_t>{ids[0]});
+        srv->broadcast(UNIT_RPC_SERVER_MSG,
+                       std::shared_ptr<const std::vector<char>>());
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(received == 7);
+        REQUIRE(msg_ok);
+        srv->stop();
+    }
+
+    SECTION("publish subscribe")
+    {
+        const uint32_t subscribe_id = UNIT_RPC_SERVER_MSG + 2;
+        std::atomic<int> received = ATOMIC_VAR_INIT(0);
+        auto srv = plain_create_server();
+        REQUIRE(srv->bind_subscribe(
+            [&](radrpc::session_context *ctx, const std::string &topic) {
+                return topic != "private";
+            }));
+        REQUIRE(srv->bind(subscribe_id, [&](radrpc::session_context *ctx) {
+            ctx->subscribe("handler");
+            ctx->response.push_back(0x1);
+        }));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto cl = plain_create_client();
+        auto clients = vector_of_object(cl);
+        for (auto i = 0; i < 3; ++i)
+        {
+            clients.emplace_back(plain_create_client());
+            clients[i]->listen_broadcast(
+                UNIT_RPC_SERVER_MSG,
+                [&](receive_buffer &p_data) { received++; });
+            REQUIRE(clients[i]->connect());
+        }
+        REQUIRE(clients[0]->subscribe("news"));
+        REQUIRE(clients[1]->subscribe("news"));
+        REQUIRE_FALSE(clients[1]->subscribe("private"));
+        REQUIRE((bool)clients[2]->send_recv(subscribe_id, std::vector<char>()));
+        REQUIRE(srv->subscribers("news") == 2);
+        REQUIRE(srv->subscribers("handler") == 1);
+        REQUIRE(srv->subscribers("private") == 0);
+        srv->publish("news", UNIT_RPC_SERVER_MSG, std::vector<char>(10, 0x1));
+        srv->publish("handler", UNIT_RPC_SERVER_MSG, std::vector<char>(10));
+        srv->publish("none", UNIT_RPC_SERVER_MSG, std::vector<char>(10));
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(received == 3);
+        REQUIRE(clients[1]->unsubscribe("news"));
+        REQUIRE_FALSE(clients[1]->unsubscribe("news"));
+        REQUIRE(srv->subscribers("news") == 1);
+        srv->publish("news", UNIT_RPC_SERVER_MSG, std::vector<char>(10));
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(received == 4);
+        REQUIRE_FALSE(srv->subscribe(0, "news"));
+        for (auto id : srv->get_session_ids())
+            REQUIRE(srv->subscribe(id, "all"));
+        REQUIRE(srv->subscribers("all") == 3);
+        clients[0]->disconnect();
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(srv->subscribers("news") == 0);
+        REQUIRE(srv->subscribers("all") == 2);
+        srv->stop();
+    }
+
     ////////////////////////////////////////////////////////
     // bind()
     ////////////////////////////////////////////////////////
@@ -240,6 +579,303 @@ TEST_CASE("plain server implementation")
         srv->stop();
     }
 
+    SECTION("bind call policy reject")
+    {
+        const uint32_t limited_id = UNIT_RPC_SERVER_MSG + 1;
+        auto srv = plain_create_server();
+        call_policy policy;
+        policy.max_concurrent = 1;
+        policy.overflow = overflow_action::reject;
+        REQUIRE(srv->bind(
+            limited_id,
+            [&](radrpc::session_context *ctx) {
+                sleep_ms(sleep_low_delay_ms * 5);
+                ctx->response.push_back(0x0);
+            },
+            policy));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto cl1 = plain_create_client();
+        auto cl2 = plain_create_client();
+        REQUIRE(cl1->connect());
+        REQUIRE(cl2->connect());
+        bool executed = false;
+        std::thread t1([&] {
+            executed = (bool)cl1->send_recv(limited_id, std::vector<char>());
+        });
+        sleep_ms(sleep_low_delay_ms);
+        REQUIRE_FALSE((bool)cl2->send_recv(limited_id, std::vector<char>()));
+        t1.join();
+        REQUIRE(executed);
+        auto stats = srv->get_call_stats(limited_id);
+        REQUIRE(stats.executing == 0);
+        REQUIRE(stats.executed == 1);
+        REQUIRE(stats.rejected == 1);
+        srv->stop();
+    }
+
+    SECTION("bind call policy queue")
+    {
+        const uint32_t limited_id = UNIT_RPC_SERVER_MSG + 1;
+        auto srv = plain_create_server();
+        call_policy policy;
+        policy.max_concurrent = 1;
+        policy.max_queued = 1;
+        policy.overflow = overflow_action::queue;
+        REQUIRE(srv->bind(
+            limited_id,
+            [&](radrpc::session_context *ctx) {
+                sleep_ms(sleep_low_delay_ms * 2);
+                ctx->response.push_back(0x0);
+            },
+            policy));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto cl1 = plain_create_client();
+        auto cl2 = plain_create_client();
+        REQUIRE(cl1->connect());
+        REQUIRE(cl2->connect());
+        bool executed = false;
+        std::thread t1([&] {
+            executed = (bool)cl1->send_recv(limited_id, std::vector<char>());
+        });
+        sleep_ms(sleep_low_delay_ms / 2);
+        REQUIRE((bool)cl2->send_recv(limited_id, std::vector<char>()));
+        t1.join();
+        REQUIRE(executed);
+        auto stats = srv->get_call_stats(limited_id);
+        REQUIRE(stats.executed == 2);
+        REQUIRE(stats.rejected == 0);
+        srv->stop();
+    }
+
+    SECTION("admission load shedding")
+    {
+        const uint32_t slow_id = UNIT_RPC_SERVER_MSG + 1;
+        auto cfg = default_server_config();
+        cfg.workers = 1;
+        cfg.admission_target = std::chrono::milliseconds(2);
+        cfg.admission_interval = std::chrono::milliseconds(20);
+        auto srv = plain_create_server(cfg);
+        REQUIRE(srv->bind(slow_id, [&](radrpc::session_context *ctx) {
+            sleep_ms(5);
+            ctx->response.push_back(0x0);
+        }));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        // Each request waits behind the requests of the other clients
+        std::atomic<int> failed = ATOMIC_VAR_INIT(0);
+        std::atomic<int> overloaded = ATOMIC_VAR_INIT(0);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 8; ++i)
+        {
+            threads.emplace_back([&] {
+                auto cl = plain_create_client();
+                cl->connect();
+                for (int j = 0; j < 20; ++j)
+                {
+                    auto result = cl->send_recv(slow_id, std::vector<char>());
+                    if (!result)
+                        failed++;
+                    if (result.status == response_status::overloaded)
+                        overloaded++;
+                }
+            });
+        }
+        for (auto &t : threads)
+            t.join();
+        auto stats = srv->get_admission_stats();
+        REQUIRE(stats.shed > 0);
+        REQUIRE(stats.shed == failed);
+        REQUIRE(stats.shed == overloaded);
+        REQUIRE(stats.admitted + stats.shed == 8 * 20);
+        // Recovers once the requests are dispatched quickly
+        sleep_ms(sleep_low_delay_ms);
+        auto cl = plain_create_client();
+        REQUIRE(cl->connect());
+        auto result = cl->send_recv(slow_id, std::vector<char>());
+        REQUIRE((bool)result);
+        REQUIRE(result.status == response_status::ok);
+        srv->stop();
+    }
+
+    SECTION("rate limit")
+    {
+        const uint32_t limited_id = UNIT_RPC_SERVER_MSG + 1;
+        for (auto action : {rate_limit_action::delay,
+                            rate_limit_action::reject,
+                            rate_limit_action::close})
+        {
+            auto session_cfg = default_session_config();
+            session_cfg.limit.requests_per_sec = 10;
+            session_cfg.limit.request_burst = 2;
+            // Unlimited requests of the default id
+            session_cfg.call_limits[UNIT_RPC_SEND_RECV] = rate_limit();
+            session_cfg.rate_limited = action;
+            auto srv = plain_create_server(
+                default_server_config(), default_server_timeout(), session_cfg);
+            std::atomic<int> executed = ATOMIC_VAR_INIT(0);
+            REQUIRE(srv->bind(limited_id, [&](radrpc::session_context *ctx) {
+                executed++;
+            }));
+            srv->async_start();
+            sleep_ms(sleep_high_delay_ms);
+            auto cl = plain_create_client();
+            REQUIRE(cl->connect());
+            for (int i = 0; i < 10; ++i)
+                REQUIRE((bool)cl->send_recv(UNIT_RPC_SEND_RECV,
+                                            std::vector<char>()));
+            for (int i = 0; i < 5; ++i)
+                REQUIRE(cl->send(limited_id, std::vector<char>()));
+            // The burst passes, the others wait 100ms each
+            // or are rejected, checked by the counters
+            auto handled = [&] {
+                auto stats = srv->get_rate_limit_stats();
+                return executed + stats.rejected >= 5 || stats.closed == 1;
+            };
+            for (int i = 0; i < 500 && !handled(); ++i)
+                sleep_ms(10);
+            auto stats = srv->get_rate_limit_stats();
+            REQUIRE(executed >= 2);
+            if (action == rate_limit_action::delay)
+            {
+                REQUIRE(executed == 5);
+                REQUIRE(stats.delayed >= 1);
+                REQUIRE(stats.rejected == 0);
+            }
+            if (action == rate_limit_action::reject)
+            {
+                REQUIRE(stats.rejected >= 1);
+                REQUIRE(executed + stats.rejected == 5);
+            }
+            if (action == rate_limit_action::close)
+            {
+                REQUIRE(executed < 5);
+                REQUIRE(stats.closed == 1);
+                for (int i = 0; i < 100 && srv->connections() != 0; ++i)
+                    sleep_ms(10);
+                REQUIRE(srv->connections() == 0);
+            }
+            srv->stop();
+        }
+    }
+
+    SECTION("fair scheduling")
+    {
+        const uint32_t slow_id = UNIT_RPC_SERVER_MSG + 1;
+        auto cfg = default_server_config();
+        cfg.workers = 4;
+        cfg.fair_concurrency = 1;
+        auto srv = plain_create_server(cfg);
+        std::atomic<int> accepted = ATOMIC_VAR_INIT(0);
+        REQUIRE(srv->bind_accept([&](radrpc::session_info &info) {
+            // The first sessions share a tenant with a higher weight
+            if (accepted++ < 3)
+            {
+                info.config.tenant = "noisy";
+                info.config.weight = 2;
+            }
+            return true;
+        }));
+        std::atomic<int> executing = ATOMIC_VAR_INIT(0);
+        std::atomic<int> max_executing = ATOMIC_VAR_INIT(0);
+        REQUIRE(srv->bind(slow_id, [&](radrpc::session_context *ctx) {
+            int current = ++executing;
+            if (current > max_executing)
+                max_executing = current;
+            sleep_ms(1);
+            executing--;
+            ctx->response.push_back(0x0);
+        }));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        std::atomic<int> received = ATOMIC_VAR_INIT(0);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 5; ++i)
+        {
+            threads.emplace_back([&] {
+                auto cl = plain_create_client();
+                cl->connect();
+                for (int j = 0; j < 20; ++j)
+                    if (cl->send_recv(slow_id, std::vector<char>()))
+                        received++;
+            });
+        }
+        for (auto &t : threads)
+            t.join();
+        REQUIRE(received == 5 * 20);
+        REQUIRE(max_executing == 1);
+        srv->stop();
+    }
+
+    SECTION("fair scheduling order")
+    {
+        const uint32_t slow_id = UNIT_RPC_SERVER_MSG + 1;
+        const int noisy_clients = 8;
+        const int requests = 10;
+        auto cfg = default_server_config();
+        cfg.workers = 4;
+        cfg.fair_concurrency = 1;
+        auto srv = plain_create_server(cfg);
+        std::mutex order_mtx;
+        std::set<uint64_t> noisy_ids;
+        std::string order;
+        REQUIRE(srv->bind_accept([&](radrpc::session_info &info) {
+            // The first sessions share the noisy tenant
+            std::lock_guard<std::mutex> lock(order_mtx);
+            if (noisy_ids.size() < noisy_clients)
+            {
+                info.config.tenant = "noisy";
+                noisy_ids.insert(info.id);
+            }
+            return true;
+        }));
+        std::atomic<bool> hold = ATOMIC_VAR_INIT(true);
+        REQUIRE(srv->bind(slow_id, [&](radrpc::session_context *ctx) {
+            // Holds the slot until the requests of all sessions are queued
+            while (hold)
+                sleep_ms(1);
+            {
+                std::lock_guard<std::mutex> lock(order_mtx);
+                order += noisy_ids.count(ctx->id) != 0 ? 'n' : 'g';
+            }
+            sleep_ms(1);
+        }));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto cl = plain_create_client();
+        auto clients = vector_of_object(cl);
+        for (int i = 0; i < noisy_clients + 2; ++i)
+        {
+            clients.push_back(plain_create_client());
+            REQUIRE(clients.back()->connect());
+        }
+        // The well-behaved tenants send after the noisy one
+        for (auto &client : clients)
+            for (int i = 0; i < requests; ++i)
+                REQUIRE(client->send(slow_id, std::vector<char>()));
+        sleep_ms(sleep_high_delay_ms);
+        hold = false;
+        const std::size_t total = (noisy_clients + 2) * requests;
+        for (int i = 0; i < 1000; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(order_mtx);
+                if (order.size() == total)
+                    break;
+            }
+            sleep_ms(10);
+        }
+        std::lock_guard<std::mutex> lock(order_mtx);
+        REQUIRE(order.size() == total);
+        REQUIRE(std::count(order.begin(), order.end(), 'g') == 2 * requests);
+        // Each round serves the noisy tenant once, so the well-behaved
+        // tenants are done long before its requests are, while
+        // serving by arrival would leave them to the last rounds.
+        REQUIRE(order.rfind('g') < total / 2);
+        srv->stop();
+    }
+
     ////////////////////////////////////////////////////////
     // bind_disconnect() / bind_accept() / bind_listen()
     ////////////////////////////////////////////////////////
@@ -413,6 +1049,161 @@ TEST_CASE("plain server implementation")
         REQUIRE(res.begin() == res.end());
     }
 
+    SECTION("ip policy")
+    {
+        auto cfg = default_server_config();
+        cfg.ip_filter.deny = {"127.0.0.0/8"};
+        auto srv = plain_create_server(cfg);
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE_FALSE(plain_create_client()->connect());
+        // Reloaded at runtime
+        ip_policy policy;
+        policy.allow = {"127.0.0.1"};
+        policy.max_connections = 1;
+        REQUIRE(srv->set_ip_policy(policy));
+        auto cl1 = plain_create_client();
+        auto cl2 = plain_create_client();
+        REQUIRE(cl1->connect());
+        REQUIRE_FALSE(cl2->connect());
+        cl1->disconnect();
+        sleep_ms(sleep_low_delay_ms);
+        REQUIRE(cl2->connect());
+        policy.allow = {"10.0.0.0/8"};
+        REQUIRE(srv->set_ip_policy(policy));
+        REQUIRE_FALSE(cl1->connect());
+        REQUIRE(srv->connections() == 1);
+        srv->stop();
+    }
+
+    SECTION("compact sessions")
+    {
+        const uint32_t handshake_id = UNIT_RPC_SERVER_MSG + 4;
+        auto cfg = default_server_config();
+        cfg.compact = true;
+        auto srv = plain_create_server(cfg);
+        REQUIRE(srv->bind_accept([&](radrpc::session_info &info) {
+            auto key_itr = info.request_handshake.find("key");
+            info.config.keep_handshake =
+                key_itr != info.request_handshake.end() &&
+                key_itr->value() == "keep";
+            info.response_handshake.insert("level", "0");
+            return true;
+        }));
+        REQUIRE(srv->bind(handshake_id, [&](session_context *ctx) {
+            auto &req = ctx->request_handshake();
+            ctx->response = {req.find("key") != req.end() ? '1' : '0'};
+        }));
+        REQUIRE(srv->bind(UNIT_RPC_SERVER_MSG + 5, [&](session_context *ctx) {
+            ctx->response.assign(ctx->data(), ctx->data() + ctx->size());
+        }));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        std::atomic<int> received = ATOMIC_VAR_INIT(0);
+        auto clients = vector_of_object(plain_create_client());
+        for (auto key : {"keep", "drop"})
+        {
+            handshake_request req;
+            req.insert("key", key);
+            clients.emplace_back(plain_create_client());
+            clients.back()->set_handshake_request(req);
+            clients.back()->listen_broadcast(
+                UNIT_RPC_SERVER_MSG, [&](receive_buffer &p_data) {
+                    received++;
+                });
+            REQUIRE(clients.back()->connect());
+            // The response handshake was sent before releasing it
+            auto res = clients.back()->get_handshake_response();
+            REQUIRE(res.find("level") != res.end());
+        }
+        REQUIRE(clients[0]->send_recv(handshake_id, {}).size() == 1);
+        REQUIRE(clients[0]->send_recv(handshake_id, {}).data()[0] == '1');
+        REQUIRE(clients[1]->send_recv(handshake_id, {}).data()[0] == '0');
+        // The released buffers & queues are allocated again
+        std::vector<char> large(64 * 1024, 'x');
+        for (int i = 0; i < 3; ++i)
+        {
+            auto echo = clients[1]->send_recv(UNIT_RPC_SERVER_MSG + 5, large);
+            REQUIRE(echo.size() == large.size());
+            REQUIRE(std::equal(large.begin(), large.end(), echo.data()));
+            srv->broadcast(UNIT_RPC_SERVER_MSG, large);
+        }
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(received == 6);
+        srv->stop();
+    }
+
+    SECTION("buffer hibernation")
+    {
+        auto session_cfg = default_session_config();
+        session_cfg.hibernate_bytes = 16 * 1024;
+        auto srv = plain_create_server(
+            default_server_config(), default_server_timeout(), session_cfg);
+        REQUIRE(srv->bind(UNIT_RPC_SERVER_MSG + 4, [&](session_context *ctx) {
+            ctx->response = {static_cast<char>(ctx->size() / 1024)};
+        }));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto cl = plain_create_client();
+        REQUIRE(cl->connect());
+        std::vector<char> large(100 * 1024, 'x');
+        REQUIRE(cl->send_recv(UNIT_RPC_SERVER_MSG + 4, large).data()[0] ==
+                100);
+        // Released after the request, since it outgrew the limit
+        sleep_ms(sleep_low_delay_ms);
+        auto stats = srv->get_buffer_pool_stats();
+        REQUIRE(stats.pooled_bytes >= 100 * 1024);
+        auto cl2 = plain_create_client();
+        REQUIRE(cl2->connect());
+        REQUIRE(cl2->send_recv(UNIT_RPC_SERVER_MSG + 4, large).data()[0] ==
+                100);
+        REQUIRE(srv->get_buffer_pool_stats().hits > stats.hits);
+        // Small requests keep their buffer, so only
+        // the responses are drawn from the pool
+        REQUIRE(cl->send_recv(UNIT_RPC_SERVER_MSG + 4, {'x'}).size() == 1);
+        sleep_ms(sleep_low_delay_ms);
+        stats = srv->get_buffer_pool_stats();
+        for (int i = 0; i < 10; ++i)
+            REQUIRE(cl->send_recv(UNIT_RPC_SERVER_MSG + 4, {'x'}).size() == 1);
+        sleep_ms(sleep_low_delay_ms);
+        auto after = srv->get_buffer_pool_stats();
+        REQUIRE(after.hits + after.misses == stats.hits + stats.misses + 10);
+        srv->stop();
+    }
+
+    SECTION("pooled responses")
+    {
+        auto srv = plain_create_server();
+        REQUIRE(srv->bind(UNIT_RPC_SERVER_MSG + 4, [&](session_context *ctx) {
+            ctx->pooled_response.assign(ctx->data(),
+                                        ctx->data() + ctx->size());
+        }));
+        // The plain response is sent instead
+        REQUIRE(srv->bind(UNIT_RPC_SERVER_MSG + 5, [&](session_context *ctx) {
+            ctx->pooled_response = {'x'};
+            ctx->response = {'y'};
+        }));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto cl = plain_create_client();
+        REQUIRE(cl->connect());
+        for (std::size_t bytes = 1; bytes <= 64 * 1024; bytes *= 4)
+        {
+            std::vector<char> request(bytes, 'x');
+            auto response = cl->send_recv(UNIT_RPC_SERVER_MSG + 4, request);
+            REQUIRE(std::vector<char>(response.data(),
+                                      response.data() + response.size()) ==
+                    request);
+        }
+        auto response = cl->send_recv(UNIT_RPC_SERVER_MSG + 5, {'x'});
+        REQUIRE(response.size() == 1);
+        REQUIRE(response.data()[0] == 'y');
+        response = cl->send_recv(UNIT_RPC_SERVER_MSG + 4, {'z'});
+        REQUIRE(response.size() == 1);
+        REQUIRE(response.data()[0] == 'z');
+        srv->stop();
+    }
+
     SECTION("sessions limit")
     {
         auto srv_cfg = default_server_config();
@@ -460,4 +1251,170 @@ TEST_CASE("plain server implementation")
         REQUIRE(cl->connect());
         srv->stop();
     }
+
+    SECTION("server io mode per worker")
+    {
+        auto cfg = default_server_config();
+        cfg.workers = 3;
+        cfg.io_mode = server_io_mode::per_worker;
+        auto srv = plain_create_server(cfg);
+        std::atomic<int> received = ATOMIC_VAR_INIT(0);
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto cl = plain_create_client();
+        auto clients = vector_of_object(cl);
+        for (auto i = 0; i < 6; ++i)
+        {
+            clients.emplace_back(plain_create_client());
+            clients[i]->listen_broadcast(
+                UNIT_RPC_SERVER_MSG,
+                [&](receive_buffer &p_data) { received++; });
+            REQUIRE(clients[i]->connect());
+            REQUIRE((bool)clients[i]->send_recv(UNIT_RPC_SEND_RECV,
+                                                std::vector<char>()));
+        }
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(srv->connections() == 6);
+        srv->broadcast(UNIT_RPC_SERVER_MSG, std::vector<char>(10, 0x1));
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(received == 6);
+        srv->stop();
+    }
+
+    SECTION("reuse port acceptors")
+    {
+        auto cfg = default_server_config();
+        cfg.workers = 3;
+        cfg.reuse_port = true;
+        cfg.pending_accepts = 4;
+        for (auto io_mode :
+             {server_io_mode::shared, server_io_mode::per_worker})
+        {
+            cfg.io_mode = io_mode;
+            auto srv = plain_create_server(cfg);
+            std::atomic<int> listened = ATOMIC_VAR_INIT(0);
+            REQUIRE(srv->bind_listen([&](const std::string &ip) {
+                listened++;
+                return true;
+            }));
+            srv->async_start();
+            sleep_ms(sleep_high_delay_ms);
+            auto cl = plain_create_client();
+            auto clients = vector_of_object(cl);
+            for (auto i = 0; i < 6; ++i)
+            {
+                clients.emplace_back(plain_create_client());
+                REQUIRE(clients[i]->connect());
+                REQUIRE((bool)clients[i]->send_recv(UNIT_RPC_SEND_RECV,
+                                                    std::vector<char>()));
+            }
+            sleep_ms(sleep_high_delay_ms);
+            REQUIRE(srv->connections() == 6);
+            REQUIRE(listened == 6);
+            clients.clear();
+            srv->stop();
+        }
+    }
+
+    SECTION("set workers")
+    {
+        auto srv = plain_create_server();
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto cl = plain_create_client();
+        auto clients = vector_of_object(cl);
+        for (auto i = 0; i < 4; ++i)
+        {
+            clients.emplace_back(plain_create_client());
+            REQUIRE(clients[i]->connect());
+        }
+        REQUIRE_FALSE(srv->set_workers(0));
+        REQUIRE(srv->set_workers(4));
+        REQUIRE(srv->workers() == 4);
+        for (auto &client : clients)
+            REQUIRE((bool)client->send_recv(UNIT_RPC_SEND_RECV,
+                                            std::vector<char>()));
+        REQUIRE(srv->set_workers(1));
+        REQUIRE(srv->workers() == 1);
+        sleep_ms(sleep_low_delay_ms);
+        for (auto &client : clients)
+            REQUIRE((bool)client->send_recv(UNIT_RPC_SEND_RECV,
+                                            std::vector<char>()));
+        REQUIRE(srv->connections() == 4);
+        srv->stop();
+        REQUIRE(srv->set_workers(2));
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(plain_connect_send_recv());
+        srv->stop();
+    }
+
+    SECTION("set workers per worker io mode")
+    {
+        auto cfg = default_server_config();
+        cfg.io_mode = server_io_mode::per_worker;
+        auto srv = plain_create_server(cfg);
+        REQUIRE_FALSE(srv->set_workers(4));
+        REQUIRE(srv->workers() == cfg.workers);
+    }
+
+    SECTION("thread placement")
+    {
+        auto cfg = default_server_config();
+        cfg.workers = 3;
+        cfg.placement.mode = placement_mode::compact;
+        auto srv = plain_create_server(cfg);
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto cl_cfg = default_client_config();
+        cl_cfg.placement.mode = placement_mode::cpus;
+        cl_cfg.placement.cpus = {0};
+        auto cl = plain_create_client(cl_cfg);
+        REQUIRE(cl->connect());
+        REQUIRE((bool)cl->send_recv(UNIT_RPC_SEND_RECV, std::vector<char>()));
+        REQUIRE(srv->set_workers(4));
+        REQUIRE(plain_connect_send_recv());
+        srv->stop();
+    }
+
+    SECTION("busy poll")
+    {
+        auto cfg = default_server_config();
+        cfg.spin_budget = std::chrono::milliseconds(1);
+        cfg.socket_busy_poll = std::chrono::microseconds(50);
+        auto srv = plain_create_server(cfg);
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        auto cl_cfg = default_client_config();
+        cl_cfg.spin_budget = std::chrono::milliseconds(1);
+        cl_cfg.socket_busy_poll = std::chrono::microseconds(50);
+        auto cl = plain_create_client(cl_cfg);
+        REQUIRE(cl->connect());
+        for (auto i = 0; i < 10; ++i)
+            REQUIRE((bool)cl->send_recv(UNIT_RPC_SEND_RECV,
+                                        std::vector<char>()));
+        cl->disconnect();
+        srv->stop();
+    }
+
+    SECTION("restart io mode per worker")
+    {
+        auto cfg = default_server_config();
+        cfg.workers = 3;
+        cfg.io_mode = server_io_mode::per_worker;
+        auto srv = plain_create_server(cfg);
+        auto cl = plain_create_client();
+        std::thread t1([&] {
+            sleep_ms(sleep_high_delay_ms);
+            REQUIRE(cl->connect());
+            REQUIRE(cl->send(UNIT_RPC_STOP, std::vector<char>()));
+        });
+        srv->start();
+        t1.join();
+        srv->stop();
+        srv->async_start();
+        sleep_ms(sleep_high_delay_ms);
+        REQUIRE(plain_connect_send_recv());
+        srv->stop();
+    }
 }
\ No newline at end of file
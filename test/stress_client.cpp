@@ -60,6 +60,8 @@ client_settings default_client_set()
     set.send_attempts = 3;
     set.attempts_delay_ms = 200;
     set.random_send_timeout = true;
+    set.stall_chance = 0;
+    set.stall_ms = 0;
     return set;
 }
 
@@ -136,6 +138,9 @@ class test_suite
                               << "\nDataError:" << ec);
             m_running = false;
         }
+        // Stops reading, so the server queues up the broadcasts
+        if (rnd_bool(m_cl_set.stall_chance))
+            sleep_ms(m_cl_set.stall_ms);
     };
 
   public:
@@ -569,6 +574,30 @@ TEST_CASE("serverside close")
     test->stop();
 }
 
+TEST_CASE("stalled readers")
+{
+    ++current_run;
+    auto cl_set = default_client_set();
+    cl_set.timeout_ms = 300;
+    cl_set.stall_chance = 2;
+    cl_set.stall_ms = 2000;
+    auto srv_set = default_server_set();
+    srv_set.broadcast_delay_ms = 5;
+    auto cl_cfg = default_client_config();
+    auto cl_timeout = default_client_timeout();
+
+    INFO("Run 'stalled readers'\n\nclient_settings:\n"
+         << cl_set << "\nserver_settings:\n"
+         << srv_set);
+
+    auto test =
+        std::make_unique<test_suite>(cl_set, srv_set, cl_cfg, cl_timeout);
+    test->set_wait_server();
+    test->run();
+    std::this_thread::sleep_for(run_time());
+    test->stop();
+}
+
 TEST_CASE("All")
 {
     ++current_run;
@@ -52,6 +52,10 @@ session_config default_session_config()
     session_config cfg;
     cfg.max_transfer_bytes = 1024 * 200;
     cfg.ping_delay = std::chrono::milliseconds(1000);
+    // Closes the sessions of stalled readers
+    cfg.max_pending_bytes = 1024 * 1024 * 8;
+    cfg.max_pending_age = std::chrono::milliseconds(1000);
+    cfg.slow_consumer = slow_consumer_action::close;
     return cfg;
 }
 